@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+
+    /* ... 'data' is aligned as any type is. */
+    union {
+        max_align_t __align;
+        char data[0];
+    };
+};
+
+/* Slow path; Allocate a new chunk, large requests get their own chunk. */
+void *__arena_alloc(struct arena *arena, size_t n)
+{
+    struct arena_chunk *chunk;
+    size_t size = (n > ARENA_CHUNK_SIZE / 4) ? n : ARENA_CHUNK_SIZE;
+
+    if ((chunk = malloc(sizeof(*chunk) + size)) == NULL)
+        return NULL;
+
+    chunk->size = size;
+    arena->size += size;
+
+    stat_inc(STAT_CHUNK);
+    stat_add(STAT_CHUNK_BYTES, size);
+
+    if (size != ARENA_CHUNK_SIZE) {
+
+        /* Keep the current chunk for next allocations. */
+
+        if (arena->chunks != NULL) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        } else {
+            chunk->next = NULL;
+            arena->chunks = chunk;
+        }
+
+        return chunk->data;
+    }
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    arena->ptr = chunk->data + n;
+    arena->end = chunk->data + size;
+
+    return chunk->data;
+}
+
+char *arena_strndup(struct arena *arena, const char *s, size_t n)
+{
+    char *str = arena_alloc_aligned(arena, n + 1, 1);
+
+    if (str != NULL) {
+        memcpy(str, s, n);
+        str[n] = '\0';
+    }
+
+    return str;
+}
+
+char *arena_strdup(struct arena *arena, const char *s)
+{
+    return arena_strndup(arena, s, strlen(s));
+}
+
+/* Move all chunks of 'src' to 'dst'; Memory allocated from 'src' is released
+ * with 'dst' afterwards. */
+void arena_splice(struct arena *dst, struct arena *src)
+{
+    struct arena_chunk *tail;
+
+    if (src->chunks == NULL)
+        return;
+
+    if (dst->chunks == NULL) {
+        *dst = *src;
+
+    } else {
+
+        /* Keep the current chunk of 'dst' for next allocations. */
+
+        for (tail = src->chunks; tail->next != NULL; tail = tail->next) ;
+
+        tail->next = dst->chunks->next;
+        dst->chunks->next = src->chunks;
+        dst->size += src->size;
+    }
+
+    *src = (struct arena) ARENA_INIT;
+}
+
+void arena_release(struct arena *arena)
+{
+    struct arena_chunk *chunk;
+
+    while ((chunk = arena->chunks) != NULL) {
+        arena->chunks = chunk->next;
+        free(chunk);
+    }
+
+    arena->ptr = arena->end = NULL;
+    arena->size = 0;
+}
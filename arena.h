@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+#include "stats.h"
+
+/* Bump allocator; Memory is allocated from large chunks and it is released
+ * all at once with 'arena_release'. */
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *chunks;
+    char *ptr, *end;            /* Free space in the current chunk. */
+
+    size_t size;                /* Total bytes allocated from chunks. */
+};
+
+#define ARENA_INIT { NULL, NULL, NULL, 0 }
+
+extern void *__arena_alloc(struct arena *, size_t);
+
+static inline void *arena_alloc_aligned(struct arena *arena, size_t n,
+    size_t align)
+{
+    char *ptr = (char *)(((unsigned long)arena->ptr + align - 1) &
+            ~(align - 1));
+
+    stat_inc(STAT_ALLOC);
+    stat_add(STAT_ALLOC_BYTES, n);
+
+    if ((arena->ptr == NULL) || (ptr + n > arena->end))
+        return __arena_alloc(arena, n);
+
+    arena->ptr = ptr + n;
+
+    return ptr;
+}
+
+#define arena_alloc(_a, _n) arena_alloc_aligned((_a), (_n), ARENA_ALIGN)
+
+extern char *arena_strndup(struct arena *, const char *, size_t);
+extern char *arena_strdup(struct arena *, const char *);
+extern void arena_splice(struct arena *, struct arena *);
+extern void arena_release(struct arena *);
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <pthread.h>
+#include <errno.h>
+
+#include "db.h"
+#include "defaults.h"
+
+/* Headers of many configurations at once, '--batch list'. Every line of
+ * 'list' names a configuration, in the format of '.old.config', and its
+ * autoconfig header; Relative paths are relative to 'list'.
+ *
+ * Workers of the pool share the linked tree of the database, each with a
+ * view of its own values, see 'share_db'. Configurations are loaded to the
+ * defaults, restored from the values of the database for each, and written
+ * as a single configuration is, so headers are the same byte for byte.
+ * Results are reported in order of 'list'. */
+
+struct variant {
+    char *config, *header;
+    int ret, err;
+};
+
+struct batch {
+    struct db *db;              /* ... evaluated, and not written. */
+
+    struct variant *variants;
+    unsigned int nr_variants, max_variants;
+    unsigned int next;          /* Next variant to build. */
+};
+
+static void build_variant(struct db *db, struct variant *variant)
+{
+    variant->ret = -1;
+
+    if (read_config_file(db, variant->config) == -1)
+        goto out;
+
+    eval_db(db);
+
+    if (build_autoconfig(db, variant->header) == -1)
+        goto out;
+
+    variant->ret = SUCCESS;
+
+out:
+    variant->err = errno;
+}
+
+static void *worker(void *arg)
+{
+    struct batch *batch = arg;
+    struct db db;
+    unsigned int i;
+
+    /* ... variants left by a failed worker are built by the others. */
+    if (share_db(&db, batch->db) == -1) {
+        release_db(&db);
+        return NULL;
+    }
+
+    while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) <
+        batch->nr_variants) {
+        build_variant(&db, &batch->variants[i]);
+
+        restore_values(&db, &batch->db->values);
+        unmap_files(&db, NULL);
+    }
+
+    release_db(&db);
+
+    return NULL;
+}
+
+static char *list_path(const char *dir, const char *file)
+{
+    size_t n = strlen(dir) + strlen(file) + 2;
+    char *path;
+
+    if (file[0] == '/')
+        return strdup(file);
+
+    if ((path = malloc(n)) != NULL)
+        snprintf(path, n, "%s/%s", dir, file);
+
+    return path;
+}
+
+static int add_variant(struct batch *batch, const char *dir,
+    const char *config, const char *header)
+{
+    struct variant *variant;
+
+    if (batch->nr_variants == batch->max_variants) {
+        unsigned int n = (batch->max_variants == 0) ?
+            64 : 2 * batch->max_variants;
+
+        if ((variant = realloc(batch->variants,
+                    n * sizeof(struct variant))) == NULL)
+            return -1;
+
+        batch->variants = variant;
+        batch->max_variants = n;
+    }
+
+    variant = &batch->variants[batch->nr_variants];
+    variant->ret = -1;
+    variant->err = ECANCELED;   /* ... until a worker builds it. */
+
+    if ((variant->config = list_path(dir, config)) == NULL)
+        return -1;
+
+    if ((variant->header = list_path(dir, header)) == NULL) {
+        free(variant->config);
+        return -1;
+    }
+
+    batch->nr_variants++;
+
+    return SUCCESS;
+}
+
+static int read_list(struct batch *batch, const char *list)
+{
+    char *line = NULL, *config, *header, *dir, *s;
+    size_t n = 0;
+    int ret = SUCCESS;
+    FILE *fp;
+
+    if ((fp = fopen(list, "r")) == NULL)
+        return -1;
+
+    /* ... paths in 'list' are relative to its directory. */
+    s = strrchr(list, '/');
+
+    if ((dir = (s != NULL) ? strndup(list, s - list) : strdup(".")) ==
+        NULL) {
+        fclose(fp);
+        return -1;
+    }
+
+    while ((ret == SUCCESS) && (getline(&line, &n, fp) != -1)) {
+        if (((config = strtok(line, " \t\n")) == NULL) ||
+            (config[0] == '#'))
+            continue;
+
+        if (((header = strtok(NULL, " \t\n")) == NULL) ||
+            (strtok(NULL, " \t\n") != NULL)) {
+            error_print("Invalid line: %s.\n", config);
+            errno = EINVAL;
+            ret = -1;
+            break;
+        }
+
+        ret = add_variant(batch, dir, config, header);
+    }
+
+    free(line);
+    free(dir);
+    fclose(fp);
+
+    return ret;
+}
+
+/* Build the headers of the configurations in 'list', an absolute path, on
+ * 'nr_jobs' threads; The calling thread counts as one. 'db' is linked and
+ * no configuration is loaded to it. */
+int batch_config(struct db *db, const char *list, int nr_jobs)
+{
+    struct batch batch = { 0 };
+    struct variant *variant;
+    pthread_t *threads = NULL;
+    unsigned int i;
+    int n, nr_threads = 0, ret = -1;
+
+    if (read_list(&batch, list) == -1) {
+        perror(list);
+        goto out;
+    }
+
+    if ((threads = calloc((nr_jobs > 1) ? nr_jobs : 1,
+                sizeof(pthread_t))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        goto out;
+    }
+
+    /* ... views copy evaluated values, see 'share_db'. */
+    eval_db(db);
+    batch.db = db;
+
+    for (n = 1; (n < nr_jobs) && (n < (int)batch.nr_variants); n++) {
+        if (pthread_create(&threads[nr_threads], NULL, worker, &batch) != 0)
+            break;              /* ... continue with fewer workers. */
+
+        nr_threads++;
+    }
+
+    worker(&batch);
+
+    while (nr_threads > 0)
+        pthread_join(threads[--nr_threads], NULL);
+
+    ret = SUCCESS;
+
+    for (i = 0; i < batch.nr_variants; i++) {
+        variant = &batch.variants[i];
+
+        if (variant->ret == SUCCESS) {
+            printf("Writing %s: Success\n", variant->header);
+            continue;
+        }
+
+        errno = variant->err;
+        perror(variant->config);
+        ret = -1;
+    }
+
+out:
+    for (i = 0; i < batch.nr_variants; i++) {
+        free(batch.variants[i].config);
+        free(batch.variants[i].header);
+    }
+
+    free(batch.variants);
+    free(threads);
+
+    return ret;
+}
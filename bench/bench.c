@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <time.h>
+#include <libgen.h>
+#include <getopt.h>
+
+#include "../db.h"
+#include "../defaults.h"
+
+/* Time every phase of a run, end to end, on configuration trees; Trees are
+ * usually generated with 'gen'. Each phase is repeated and the minimum,
+ * mean and maximum wall time are reported as CSV or JSON.
+ *
+ *   parse   'yy_parse_file' and 'parse_includes'
+ *   link    'link_db'
+ *   dump    'create_config_file', i.e. '__populate_config_file' of defaults
+ *   read    'read_config_file'
+ *   header  'build_autoconfig'
+ *   write   'write_config_file', i.e. '__populate_config_file' */
+
+#define OLD_CONFIG ".bench.old.config"
+#define SYS_CONFIG ".bench.sys.config.h"
+
+enum phase { PARSE, LINK, DUMP, READ, HEADER, WRITE, NR_PHASES };
+
+static const char *phase_names[NR_PHASES] = {
+    "parse", "link", "dump", "read", "header", "write"
+};
+
+struct result {
+    double min, sum, max;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void record(struct result *r, double t0)
+{
+    double t = now() - t0;
+
+    if ((r->sum == 0) || (t < r->min))
+        r->min = t;
+
+    if (t > r->max)
+        r->max = t;
+
+    r->sum += t;
+}
+
+static int load(struct db *db, const char *file, int nr_jobs,
+    struct result *results)
+{
+    double t0;
+
+    init_db(db);
+
+    t0 = now();
+    if ((yy_parse_file(db, file) != 0) || (parse_includes(db, nr_jobs) == -1))
+        return -1;
+
+    record(&results[PARSE], t0);
+
+    t0 = now();
+    if (link_db(db) == -1)
+        return -1;
+
+    record(&results[LINK], t0);
+
+    return SUCCESS;
+}
+
+static int run(const char *file, int reps, int nr_jobs,
+    struct result *results, unsigned int *nr_items)
+{
+    struct db db;
+    double t0;
+    int i;
+
+    for (i = 0; i < reps; i++) {
+        if (load(&db, file, nr_jobs, results) == -1)
+            return -1;
+
+        unlink(OLD_CONFIG);
+
+        t0 = now();
+        if (create_config_file(&db, OLD_CONFIG) == -1)
+            return -1;
+
+        record(&results[DUMP], t0);
+
+        t0 = now();
+        if (read_config_file(&db, OLD_CONFIG) == -1)
+            return -1;
+
+        record(&results[READ], t0);
+
+        /* ... files are replaced only if they change, so remove them to
+         * time the write as well. */
+
+        unlink(SYS_CONFIG);
+
+        t0 = now();
+        if (build_autoconfig(&db, SYS_CONFIG) == -1)
+            return -1;
+
+        record(&results[HEADER], t0);
+
+        unlink(OLD_CONFIG);
+
+        t0 = now();
+        if (write_config_file(&db, OLD_CONFIG) == -1)
+            return -1;
+
+        record(&results[WRITE], t0);
+
+        *nr_items = db.nr_items;
+        release_db(&db);
+    }
+
+    unlink(OLD_CONFIG);
+    unlink(SYS_CONFIG);
+
+    return SUCCESS;
+}
+
+static void print_help(char *pname)
+{
+    printf("\nUse: %s [OPTIONS] configs.in ...\n", pname);
+    printf("  [--reps n]           repeat every phase 'n' times (default 5)\n");
+    printf("  [--jobs n]           parse included files on 'n' threads\n");
+    printf("  [--json]             print JSON instead of CSV\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int reps = 5, json = 0, nr_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, p, first = 1;
+    char *cwd;
+    FILE *out;
+
+    while (1) {
+        static struct option long_options[] = {
+            {"reps", required_argument, NULL, 'r'},
+            {"jobs", required_argument, NULL, 'j'},
+            {"json", no_argument, NULL, 'J'},
+            {"help", no_argument, NULL, 'h'},
+            {0, 0, 0, 0}
+        };
+
+        int c = getopt_long(argc, argv, "", long_options, NULL);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'r':
+            reps = (atoi(optarg) > 0) ? atoi(optarg) : 1;
+            break;
+
+        case 'j':
+            nr_jobs = atoi(optarg);
+            break;
+
+        case 'J':
+            json = 1;
+            break;
+
+        case 'h':
+            print_help(argv[0]);
+            return SUCCESS;
+
+        default:
+            print_help(argv[0]);
+            return -1;
+        }
+    }
+
+    if ((cwd = getcwd(NULL, 0)) == NULL)
+        return -1;
+
+    /* ... results go to stdout, progress messages of phases are dropped. */
+    if (((out = fdopen(dup(STDOUT_FILENO), "w")) == NULL) ||
+        (freopen("/dev/null", "w", stdout) == NULL))
+        return -1;
+
+    fprintf(out, json ? "[\n" : "file,items,phase,reps,min,mean,max\n");
+
+    for (i = optind; i < argc; i++) {
+        struct result results[NR_PHASES] = { 0 };
+        char *dir = strdup(argv[i]), *base = strdup(argv[i]);
+        unsigned int nr_items = 0;
+
+        /* ... included files are relative to the main configuration file. */
+        if ((chdir(cwd) == -1) || (chdir(dirname(dir)) == -1) ||
+            (run(basename(base), reps, nr_jobs, results, &nr_items) == -1)) {
+            error_print("%s failed.\n", argv[i]);
+            return -1;
+        }
+
+        for (p = 0; p < NR_PHASES; p++) {
+            struct result *r = &results[p];
+
+            if (json)
+                fprintf(out, "%s  {\"file\": \"%s\", \"items\": %u, "
+                    "\"phase\": \"%s\", \"reps\": %d, \"min\": %.9f, "
+                    "\"mean\": %.9f, \"max\": %.9f}", first ? "" : ",\n",
+                    argv[i], nr_items, phase_names[p], reps, r->min,
+                    r->sum / reps, r->max);
+            else
+                fprintf(out, "%s,%u,%s,%d,%.9f,%.9f,%.9f\n", argv[i],
+                    nr_items, phase_names[p], reps, r->min, r->sum / reps,
+                    r->max);
+
+            first = 0;
+        }
+
+        free(dir);
+        free(base);
+    }
+
+    if (json)
+        fprintf(out, "\n]\n");
+
+    fclose(out);
+    free(cwd);
+
+    return SUCCESS;
+}
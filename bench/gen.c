@@ -0,0 +1,342 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <errno.h>
+
+/* Generate a synthetic configuration tree for benchmarks. Symbols are split
+ * evenly over a tree of included files, 'fanout' files per file down to
+ * 'levels' levels. In a file, items are grouped in chains of 'depth' nested
+ * menus.
+ *
+ * Every tenth symbol is an 'INTEGER', a 'STRING' or a choice, the rest are
+ * 'BOOL'. Every other item depends on an expression with 'leaves' operands,
+ * which refer to symbols defined before, so there are no cycles. 'BOOL'
+ * symbols select the next 'BOOL' symbol in chains of 'chain' symbols. */
+
+#define GROUP 64                /* Items in a chain of menus. */
+
+struct params {
+    unsigned int symbols, depth, fanout, levels, leaves, chain, options;
+    unsigned long long seed;
+};
+
+static unsigned long long state;
+
+static unsigned int rnd(unsigned int n)
+{
+    state ^= state << 13;       /* xorshift64. */
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    return (n > 0) ? (unsigned int)(state % n) : 0;
+}
+
+enum kind { K_BOOL, K_INTEGER, K_STRING, K_CHOICE };
+
+static enum kind kind(unsigned int i)
+{
+    switch (i % 10) {
+    case 0:
+        return K_INTEGER;
+    case 1:
+        return K_STRING;
+    case 2:
+        return K_CHOICE;
+    default:
+        return K_BOOL;
+    }
+}
+
+/* A symbol of kind 'k' defined before 'i', if any. */
+static bool earlier(unsigned int i, enum kind k, unsigned int *j)
+{
+    unsigned int n;
+
+    if (i < 10)
+        return false;
+
+    for (n = rnd(i); kind(n) != k; n = (n + 1) % i) ;
+
+    *j = n;
+
+    return true;
+}
+
+static void print_expr(FILE *fp, unsigned int i, unsigned int leaves)
+{
+    unsigned int j, left;
+
+    if (leaves > 1) {
+        left = 1 + rnd(leaves - 1);
+
+        fprintf(fp, "(");
+        print_expr(fp, i, left);
+        fprintf(fp, rnd(2) ? " && " : " || ");
+        print_expr(fp, i, leaves - left);
+        fprintf(fp, ")");
+
+        return;
+    }
+
+    switch (rnd(4)) {
+    case 0:
+        if (earlier(i, K_INTEGER, &j)) {
+            fprintf(fp, "CONFIG_S%06u %s %u", j, rnd(2) ? "==" : "!=", j);
+            return;
+        }
+
+        break;
+
+    case 1:
+        if (earlier(i, K_BOOL, &j)) {
+            fprintf(fp, "NOT CONFIG_S%06u", j);
+            return;
+        }
+
+        break;
+    }
+
+    if (earlier(i, K_BOOL, &j))
+        fprintf(fp, "CONFIG_S%06u", j);
+    else
+        fprintf(fp, "true == true");
+}
+
+/* Next 'BOOL' symbol after 'i', if 'i' is not the last in its chain. */
+static bool next_select(const struct params *p, unsigned int i,
+    unsigned int *j)
+{
+    unsigned int n;
+
+    /* ... ordinal of 'i' among 'BOOL' symbols. */
+    if ((p->chain < 2) || (((i / 10) * 7 + (i % 10) - 3) % p->chain ==
+            p->chain - 1))
+        return false;
+
+    for (n = i + 1; (n < p->symbols) && (kind(n) != K_BOOL); n++) ;
+
+    *j = n;
+
+    return n < p->symbols;
+}
+
+static void print_item(FILE *fp, const struct params *p, unsigned int i)
+{
+    unsigned int j;
+
+    switch (kind(i)) {
+    case K_INTEGER:
+        fprintf(fp, "config \"Integer %u\" CONFIG_S%06u INTEGER %u\n", i, i,
+            i);
+        break;
+
+    case K_STRING:
+        fprintf(fp, "config \"String %u\" CONFIG_S%06u STRING \"s%u\"\n", i,
+            i, i);
+        break;
+
+    case K_CHOICE:
+        fprintf(fp, "choice \"Choice %u\" CONFIG_S%06u\n", i, i);
+
+        for (j = 0; j < p->options; j++) {
+            fprintf(fp, "    option \"o%u\"", j);
+
+            if ((j > 0) && (j % 4 == 3)) {
+                fprintf(fp, " if ");
+                print_expr(fp, i, 1);
+            }
+
+            fprintf(fp, "%s\n", (j == 0) ? " [default]" : "");
+        }
+
+        break;
+
+    case K_BOOL:
+        fprintf(fp, "config \"Bool %u\" CONFIG_S%06u BOOL %s", i, i,
+            rnd(2) ? "true" : "false");
+
+        if (next_select(p, i, &j))
+            fprintf(fp, " select CONFIG_S%06u", j);
+
+        fprintf(fp, "\n");
+    }
+
+    if ((i % 2 == 1) && (p->leaves > 0)) {
+        fprintf(fp, "    depends ");
+        print_expr(fp, i, p->leaves);
+        fprintf(fp, "\n");
+    }
+
+    if (i % 16 == 0)
+        fprintf(fp, "    help \"Help of symbol %u.\"\n", i);
+}
+
+static unsigned int nr_files(const struct params *p)
+{
+    unsigned int n = 1, level = 1, i;
+
+    for (i = 0; i < p->levels; i++)
+        n += (level *= p->fanout);
+
+    return n;
+}
+
+/* Write file 'id' of 'nr' files, with its includes; Files are numbered in
+ * breadth-first order, so children of 'id' are 'id * fanout + 1 ...'. */
+static int print_file(const char *dir, const struct params *p,
+    unsigned int id, unsigned int nr)
+{
+    unsigned int first = (unsigned long long)p->symbols * id / nr;
+    unsigned int last = (unsigned long long)p->symbols * (id + 1) / nr;
+    unsigned int i, j, child;
+    char path[4096];
+    FILE *fp;
+
+    if (id == 0)
+        snprintf(path, sizeof(path), "%s/configs.in", dir);
+    else
+        snprintf(path, sizeof(path), "%s/sub/f%u.in", dir, id);
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(fp, "# Generated by 'gen', file %u of %u.\n\n", id, nr);
+
+    for (i = first; i < last; i += GROUP) {
+        for (j = 0; j < p->depth; j++) {
+            fprintf(fp, "menu \"Menu %u.%u\"\n", i, j);
+
+            if ((j == p->depth - 1) && (i % 4 == 0) && (p->leaves > 0)) {
+                fprintf(fp, "    depends ");
+                print_expr(fp, i, 1);
+                fprintf(fp, "\n");
+            }
+        }
+
+        for (j = i; (j < last) && (j < i + GROUP); j++)
+            print_item(fp, p, j);
+
+        for (j = 0; j < p->depth; j++)
+            fprintf(fp, "endmenu\n");
+    }
+
+    for (i = 1; i <= p->fanout; i++) {
+        if ((child = id * p->fanout + i) < nr)
+            fprintf(fp, ".include \"sub/f%u.in\"\n", child);
+    }
+
+    return fclose(fp);
+}
+
+static void print_help(char *pname)
+{
+    printf("\nUse: %s [OPTIONS] dir\n", pname);
+    printf("  [--symbols n]        number of symbols (default 1000)\n");
+    printf("  [--depth n]          depth of nested menus (default 2)\n");
+    printf("  [--fanout n]         files included per file (default 4)\n");
+    printf("  [--levels n]         levels of included files (default 2)\n");
+    printf("  [--leaves n]         operands in 'depends' (default 3)\n");
+    printf("  [--chain n]          length of select chains (default 4)\n");
+    printf("  [--options n]        options per choice (default 8)\n");
+    printf("  [--seed n]           random seed (default 1)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct params p = { 1000, 2, 4, 2, 3, 4, 8, 1 };
+    char path[4096];
+    unsigned int i, nr;
+
+    while (1) {
+        static struct option long_options[] = {
+            {"symbols", required_argument, NULL, 'n'},
+            {"depth", required_argument, NULL, 'd'},
+            {"fanout", required_argument, NULL, 'f'},
+            {"levels", required_argument, NULL, 'l'},
+            {"leaves", required_argument, NULL, 'e'},
+            {"chain", required_argument, NULL, 's'},
+            {"options", required_argument, NULL, 'c'},
+            {"seed", required_argument, NULL, 'r'},
+            {"help", no_argument, NULL, 'h'},
+            {0, 0, 0, 0}
+        };
+
+        int c = getopt_long(argc, argv, "", long_options, NULL);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'n':
+            p.symbols = atoi(optarg);
+            break;
+
+        case 'd':
+            p.depth = atoi(optarg);
+            break;
+
+        case 'f':
+            p.fanout = atoi(optarg);
+            break;
+
+        case 'l':
+            p.levels = atoi(optarg);
+            break;
+
+        case 'e':
+            p.leaves = atoi(optarg);
+            break;
+
+        case 's':
+            p.chain = atoi(optarg);
+            break;
+
+        case 'c':
+            p.options = (atoi(optarg) > 0) ? atoi(optarg) : 1;
+            break;
+
+        case 'r':
+            p.seed = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'h':
+            print_help(argv[0]);
+            return EXIT_SUCCESS;
+
+        default:
+            print_help(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1) {
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    state = p.seed ? p.seed : 1;
+    nr = (p.fanout > 0) ? nr_files(&p) : 1;
+
+    snprintf(path, sizeof(path), "%s/sub", argv[optind]);
+
+    if (((mkdir(argv[optind], 0777) == -1) && (errno != EEXIST)) ||
+        ((mkdir(path, 0777) == -1) && (errno != EEXIST))) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < nr; i++) {
+        if (print_file(argv[optind], &p, i, nr) == -1)
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,355 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <ctype.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "../db.h"
+#include "../defaults.h"
+
+/* Microbenchmarks of the hot paths: 'eval_expr' and 'eval_db', symbol lookup,
+ * choices and select propagation. A configuration tree is written to a
+ * temporary directory and parsed as usual. Every benchmark is warmed up, then
+ * timed for a number of repetitions; ns/op is reported with its deviation. */
+
+#define NR_BOOLS 256
+
+struct bench {
+    const char *name;
+    void (*fn)(struct db *, void *, unsigned long);
+    void *arg;
+};
+
+static volatile unsigned long sink;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static item_t *get_item(struct db *db, const char *name)
+{
+    return hash_get_item(db, sym_lookup(&db->symtab, name, strlen(name)));
+}
+
+/* Print an expression of 'leaves' operands; 'AND' of 'true' and 'OR' of
+ * 'false' symbols do not short-circuit. */
+static void print_expr(FILE *fp, const char *mix, unsigned int leaves,
+    unsigned int *n)
+{
+    unsigned int left = leaves / 2;
+
+    if (leaves > 1) {
+        fprintf(fp, "(");
+        print_expr(fp, mix, left, n);
+
+        if (strcmp(mix, "and") == 0)
+            fprintf(fp, " && ");
+        else if (strcmp(mix, "or") == 0)
+            fprintf(fp, " || ");
+        else
+            fprintf(fp, (*n % 2) ? " && " : " || ");
+
+        print_expr(fp, mix, leaves - left, n);
+        fprintf(fp, ")");
+
+        return;
+    }
+
+    (*n)++;
+
+    if (strcmp(mix, "and") == 0)
+        fprintf(fp, "T%u", *n % (NR_BOOLS / 2));
+    else if (strcmp(mix, "or") == 0)
+        fprintf(fp, "F%u", *n % (NR_BOOLS / 2));
+    else if (*n % 3 == 0)
+        fprintf(fp, "NOT F%u", *n % (NR_BOOLS / 2));
+    else if (*n % 3 == 1)
+        fprintf(fp, "I%u == %u", *n % 16, *n % 16);
+    else
+        fprintf(fp, "S%u != \"x\"", *n % 16);
+}
+
+static const char *mixes[] = { "and", "or", "mixed", NULL };
+static const unsigned int depths[] = { 1, 4, 16, 64, 0 };
+static const unsigned int fanouts[] = { 8, 64, 1024, 0 };
+
+static int write_tree(const char *file)
+{
+    unsigned int i, j, n = 0;
+    FILE *fp;
+
+    if ((fp = fopen(file, "w")) == NULL)
+        return -1;
+
+    for (i = 0; i < NR_BOOLS / 2; i++) {
+        fprintf(fp, "config \"\" T%u BOOL true\n", i);
+        fprintf(fp, "config \"\" F%u BOOL false\n", i);
+    }
+
+    for (i = 0; i < 16; i++) {
+        fprintf(fp, "config \"\" I%u INTEGER %u\n", i, i);
+        fprintf(fp, "config \"\" S%u STRING \"s%u\"\n", i, i);
+    }
+
+    /* ... expressions are dependencies of 'E_<mix>_<leaves>'. */
+
+    for (i = 0; mixes[i] != NULL; i++) {
+        for (j = 0; depths[j] != 0; j++) {
+            fprintf(fp, "config \"\" E_%c_%u BOOL true depends ",
+                toupper(mixes[i][0]), depths[j]);
+            print_expr(fp, mixes[i], depths[j], &n);
+            fprintf(fp, "\n");
+        }
+    }
+
+    /* ... choices of 'n' options, and 'n' items selected by 'WIDE_<n>' or
+     * a chain of 'n' items from 'DEEP_<n>_0'. */
+
+    for (i = 0; fanouts[i] != 0; i++) {
+        fprintf(fp, "choice \"\" C%u", fanouts[i]);
+        for (j = 0; j < fanouts[i]; j++)
+            fprintf(fp, " option %u%s", j, (j == 0) ? " [default]" : "");
+
+        fprintf(fp, "\nconfig \"\" WIDE_%u BOOL false", fanouts[i]);
+        for (j = 0; j < fanouts[i]; j++)
+            fprintf(fp, " select W%u_%u", fanouts[i], j);
+
+        fprintf(fp, "\n");
+
+        for (j = 0; j < fanouts[i]; j++) {
+            fprintf(fp, "config \"\" W%u_%u BOOL false\n", fanouts[i], j);
+            fprintf(fp, "config \"\" DEEP_%u_%u BOOL false", fanouts[i], j);
+
+            if (j + 1 < fanouts[i])
+                fprintf(fp, " select DEEP_%u_%u", fanouts[i], j + 1);
+
+            fprintf(fp, "\n");
+        }
+    }
+
+    return fclose(fp);
+}
+
+static void bench_eval(struct db *db, void *arg, unsigned long n)
+{
+    while (n-- > 0) {
+        invalidate_expr(db, arg);
+        sink += eval_expr(db, arg);
+    }
+}
+
+/* Evaluate every item, as for the header of a configuration. */
+static void bench_eval_db(struct db *db, void *arg, unsigned long n)
+{
+    while (n-- > 0) {
+        invalidate_db(db);
+        eval_db(db);
+    }
+}
+
+static void bench_lookup(struct db *db, void *arg, unsigned long n)
+{
+    char **names = arg;
+    unsigned int i = 0;
+
+    while (n-- > 0) {
+        sink += (unsigned long)hash_get_item(db, sym_lookup(&db->symtab,
+                    names[i], strlen(names[i])));
+
+        if (names[++i] == NULL)
+            i = 0;
+    }
+}
+
+struct choice {
+    item_t *item;
+    char first[16], last[16];
+};
+
+static void bench_choice(struct db *db, void *arg, unsigned long n)
+{
+    struct choice *c = arg;
+
+    /* ... the last option is the slowest to find. */
+    while (n-- > 0)
+        toggle_choice(db, c->item, (n % 2) ? c->last : c->first);
+}
+
+static void bench_toggle(struct db *db, void *arg, unsigned long n)
+{
+    while (n-- > 0)
+        toggle_config(db, arg);
+
+    /* ... settle the evaluation queue. */
+    eval_item(db, arg);
+}
+
+static void run(struct db *db, struct bench *b, unsigned long ops,
+    int warmup, int reps)
+{
+    double t, sum = 0, sq = 0, min = 0;
+    int i;
+
+    for (i = 0; i < warmup; i++)
+        b->fn(db, b->arg, ops);
+
+    for (i = 0; i < reps; i++) {
+        t = now();
+        b->fn(db, b->arg, ops);
+        t = (now() - t) / ops;
+
+        if ((i == 0) || (t < min))
+            min = t;
+
+        sum += t;
+        sq += t * t;
+    }
+
+    t = sum / reps;
+
+    printf("%-24s %10.1f ns/op  +- %8.1f  min %10.1f  (%d x %lu ops)\n",
+        b->name, t, sqrt((sq / reps - t * t) > 0 ? sq / reps - t * t : 0),
+        min, reps, ops);
+}
+
+static void print_help(char *pname)
+{
+    printf("\nUse: %s [OPTIONS]\n", pname);
+    printf("  [--ops n]            operations per repetition (default 10000)\n");
+    printf("  [--reps n]           timed repetitions (default 10)\n");
+    printf("  [--warmup n]         warm-up repetitions (default 2)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/uconfig-micro.XXXXXX", file[64], name[64];
+    char *hits[NR_BOOLS + 1], *misses[NR_BOOLS + 1];
+    unsigned long ops = 10000;
+    int warmup = 2, reps = 10;
+    unsigned int i, j;
+    struct bench b;
+    struct db db;
+
+    while (1) {
+        static struct option long_options[] = {
+            {"ops", required_argument, NULL, 'n'},
+            {"reps", required_argument, NULL, 'r'},
+            {"warmup", required_argument, NULL, 'w'},
+            {"help", no_argument, NULL, 'h'},
+            {0, 0, 0, 0}
+        };
+
+        int c = getopt_long(argc, argv, "", long_options, NULL);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'n':
+            ops = (atol(optarg) > 0) ? atol(optarg) : 1;
+            break;
+
+        case 'r':
+            reps = (atoi(optarg) > 0) ? atoi(optarg) : 1;
+            break;
+
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+
+        case 'h':
+            print_help(argv[0]);
+            return SUCCESS;
+
+        default:
+            print_help(argv[0]);
+            return -1;
+        }
+    }
+
+    if (mkdtemp(dir) == NULL)
+        return -1;
+
+    snprintf(file, sizeof(file), "%s/configs.in", dir);
+    init_db(&db);
+
+    if ((write_tree(file) == -1) || (yy_parse_file(&db, file) != 0) ||
+        (link_db(&db) == -1)) {
+        error_print("building the tree failed.\n");
+        unlink(file);
+        rmdir(dir);
+        return -1;
+    }
+
+    unlink(file);
+    rmdir(dir);
+
+    for (i = 0; mixes[i] != NULL; i++) {
+        for (j = 0; depths[j] != 0; j++) {
+            snprintf(name, sizeof(name), "E_%c_%u", toupper(mixes[i][0]),
+                depths[j]);
+            b.arg = get_item(&db, name)->common.dependency;
+
+            snprintf(name, sizeof(name), "eval_expr/%s/%u", mixes[i],
+                depths[j]);
+            b.name = name;
+            b.fn = bench_eval;
+            run(&db, &b, ops, warmup, reps);
+        }
+    }
+
+    b = (struct bench) { "eval_db/full", bench_eval_db, NULL };
+    run(&db, &b, ops / 100 + 1, warmup, reps);
+
+    for (i = 0; i < NR_BOOLS; i++) {
+        hits[i] = sym_name(&db.symtab, i);
+        misses[i] = alloca(16);
+        snprintf(misses[i], 16, "MISS%u", i);
+    }
+
+    hits[i] = misses[i] = NULL;
+
+    b = (struct bench) { "hash_get_item/hit", bench_lookup, hits };
+    run(&db, &b, ops, warmup, reps);
+
+    b = (struct bench) { "hash_get_item/miss", bench_lookup, misses };
+    run(&db, &b, ops, warmup, reps);
+
+    for (i = 0; fanouts[i] != 0; i++) {
+        struct choice c;
+
+        snprintf(name, sizeof(name), "C%u", fanouts[i]);
+        c.item = get_item(&db, name);
+        snprintf(c.first, sizeof(c.first), "0");
+        snprintf(c.last, sizeof(c.last), "%u", fanouts[i] - 1);
+
+        snprintf(name, sizeof(name), "toggle_choice/%u", fanouts[i]);
+        b = (struct bench) { name, bench_choice, &c };
+        run(&db, &b, ops, warmup, reps);
+    }
+
+    for (i = 0; fanouts[i] != 0; i++) {
+        snprintf(name, sizeof(name), "WIDE_%u", fanouts[i]);
+        b.arg = get_item(&db, name);
+
+        snprintf(name, sizeof(name), "toggle_config/wide/%u", fanouts[i]);
+        b.name = name;
+        b.fn = bench_toggle;
+        run(&db, &b, ops, warmup, reps);
+
+        snprintf(name, sizeof(name), "DEEP_%u_0", fanouts[i]);
+        b.arg = get_item(&db, name);
+
+        snprintf(name, sizeof(name), "toggle_config/deep/%u", fanouts[i]);
+        run(&db, &b, ops, warmup, reps);
+    }
+
+    release_db(&db);
+
+    return SUCCESS;
+}
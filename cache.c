@@ -0,0 +1,741 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <fcntl.h>
+
+#include "db.h"
+#include "defaults.h"
+#include "y.tab.h"
+
+/* The binary cache holds the linked database, i.e. the menu tree, items, token
+ * lists and compiled expressions, as a position independent image: Objects
+ * are copied to the image and pointers are replaced with offsets in the image.
+ * Loading is a single 'mmap' and adding the base address to every pointer in
+ * the relocation table.
+ *
+ * The cache is keyed by path, mtime, size and content hash of every parsed
+ * file. It is used if all files have the same size and either the same mtime
+ * or the same content; Otherwise, files are parsed again. It is keyed by the
+ * name of the main configuration file as well, so '--config' of another file
+ * in the same directory does not load it; No other option changes the tree.
+ *
+ * File layout:
+ *
+ *   struct cache_header
+ *   struct cache_file      files[nr_files]
+ *   unsigned long          relocs[nr_relocs]
+ *   char                   root[root_size], the main configuration file
+ *   ...                    image, at 'image' offset. */
+
+#define CACHE_MAGIC "UCFGCACH"
+#define CACHE_VERSION 5
+#define CACHE_ALIGN 16
+
+struct cache_header {
+    char magic[8];
+    unsigned int version;
+
+    /* ... layout of the database in this build. */
+    unsigned int sizeof_db, sizeof_item, sizeof_menu;
+
+    unsigned long nr_files, nr_relocs, root_size;
+    unsigned long image, image_size;
+    unsigned long db;           /* Offset of 'struct db' in the image. */
+};
+
+struct cache_file {
+    unsigned long path;         /* Offset of the path in the image. */
+    struct timespec mtime;
+    unsigned long size;
+    unsigned long long hash;
+};
+
+struct image_object {
+    const char *addr;
+    size_t size, offset;
+};
+
+/* The image is built in two passes over the database; The first pass collects
+ * objects, the second pass copies them and relocates pointers. */
+
+struct image {
+    int pass;
+    bool failed;
+
+    struct image_object *objects;
+    size_t nr_objects, max_objects;
+
+    char *data;
+    size_t size;
+
+    unsigned long *relocs;
+    size_t nr_relocs, max_relocs;
+};
+
+unsigned long long cache_hash(const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    unsigned long long hash = 14695981039346656037ULL;  /* FNV-1a. */
+
+    while (size-- > 0) {
+        hash ^= *p++;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static struct image_object *image_lookup(struct image *image, const void *ptr)
+{
+    const char *p = ptr;
+    size_t lo = 0, hi = image->nr_objects;
+
+    /* ... the object contains 'ptr', e.g. list heads point inside items. */
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (image->objects[mid].addr <= p)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if ((lo == 0) || (p >= image->objects[lo - 1].addr +
+            image->objects[lo - 1].size)) {
+        image->failed = true;
+        return NULL;
+    }
+
+    return &image->objects[lo - 1];
+}
+
+static unsigned long image_offset(struct image *image, const void *ptr)
+{
+    struct image_object *obj = image_lookup(image, ptr);
+
+    if (obj == NULL)
+        return 0;
+
+    return obj->offset + ((const char *)ptr - obj->addr);
+}
+
+void image_object(struct image *image, const void *addr, size_t size)
+{
+    struct image_object *obj;
+
+    if (image->pass == 1) {
+        if (image->nr_objects == image->max_objects) {
+            size_t n = (image->max_objects == 0) ?
+                1024 : 2 * image->max_objects;
+
+            if ((obj = realloc(image->objects,
+                        n * sizeof(struct image_object))) == NULL) {
+                image->failed = true;
+                return;
+            }
+
+            image->objects = obj;
+            image->max_objects = n;
+        }
+
+        /* ... empty objects still have an address, e.g. 'readers' of an
+         * item without readers. */
+
+        obj = &image->objects[image->nr_objects++];
+        obj->addr = addr;
+        obj->size = (size > 0) ? size : 1;
+
+    } else if (image_lookup(image, addr) != NULL)
+        memcpy(image->data + image_offset(image, addr), addr, size);
+}
+
+/* 'field' is a pointer in an object added to the image. */
+void image_pointer(struct image *image, void *field)
+{
+    void *ptr = *(void **)field;
+    unsigned long offset;
+
+    if ((image->pass == 1) || (ptr == NULL))
+        return;
+
+    if (image->nr_relocs == image->max_relocs) {
+        size_t n = (image->max_relocs == 0) ? 1024 : 2 * image->max_relocs;
+        unsigned long *relocs = realloc(image->relocs,
+                n * sizeof(unsigned long));
+
+        if (relocs == NULL) {
+            image->failed = true;
+            return;
+        }
+
+        image->relocs = relocs;
+        image->max_relocs = n;
+    }
+
+    offset = image_offset(image, field);
+
+    *(unsigned long *)(image->data + offset) = image_offset(image, ptr);
+    image->relocs[image->nr_relocs++] = offset;
+}
+
+void image_string(struct image *image, char **field)
+{
+    if (*field != NULL)
+        image_object(image, *field, strlen(*field) + 1);
+
+    image_pointer(image, field);
+}
+
+void image_token(struct image *image, token_t *token)
+{
+    if (token->ttype == TT_DESCRIPTION)
+        image_string(image, &token->TK_STRING);
+}
+
+static void image_list(struct image *image, LIST_HEAD *head)
+{
+    image_pointer(image, &head->next);
+    image_pointer(image, &head->prev);
+}
+
+static void image_expr(struct image *image, expr_t *field)
+{
+    expr_t expr = *field;
+
+    image_pointer(image, field);
+
+    if (expr == NULL)
+        return;
+
+    image_object(image, expr, sizeof(*expr));
+    image_pointer(image, &expr->code);
+
+    switch (expr->op) {
+    case OP_EQUAL:
+    case OP_NEQUAL:
+        image_token(image, &expr->LEFT.token);
+
+    case OP_NULL:
+        image_token(image, &expr->RIGHT.token);
+        break;
+
+    case OP_AND:
+    case OP_OR:
+        image_expr(image, &expr->LEFT.expr);
+
+    case OP_NOT:
+        image_expr(image, &expr->RIGHT.expr);
+        break;
+    }
+}
+
+static void image_item(struct image *image, item_t *item)
+{
+    struct extended_token *et;
+    unsigned int i;
+
+    image_object(image, item, sizeof(*item));
+    image_string(image, &item->common.prompt);
+    image_string(image, &item->common.symbol);
+    image_expr(image, &item->common.dependency);
+    image_string(image, &item->common.help);
+
+    image_pointer(image, &item->tk_list);
+    item_token_list_for_each_entry(et, item) {
+        image_object(image, et, sizeof(*et));
+        image_token(image, &et->token);
+        image_expr(image, &et->condition);
+        image_pointer(image, &et->node.next);
+    }
+
+    image_pointer(image, &item->options);
+    if (item->options != NULL) {
+        image_object(image, item->options,
+            item->nr_options * sizeof(struct extended_token *));
+
+        for (i = 0; i < item->nr_options; i++)
+            image_pointer(image, &item->options[i]);
+    }
+
+    image_pointer(image, &item->readers);
+    if (item->readers != NULL) {
+        image_object(image, item->readers,
+            item->nr_readers * sizeof(struct bytecode *));
+
+        for (i = 0; i < item->nr_readers; i++)
+            image_pointer(image, &item->readers[i]);
+    }
+
+    image_pointer(image, &item->selects);
+    image_pointer(image, &item->selectors);
+    image_object(image, item->selects,
+        (item->nr_selects + item->nr_selectors) * sizeof(item_t *));
+
+    for (i = 0; i < item->nr_selects; i++)
+        image_pointer(image, &item->selects[i]);
+
+    for (i = 0; i < item->nr_selectors; i++)
+        image_pointer(image, &item->selectors[i]);
+
+    image_list(image, &item->node);
+    image_list(image, &item->sym_node);
+}
+
+/* 'main_menu' is a part of 'struct db', it is not an object on its own. */
+static void image_menu(struct image *image, menu_t *menu, bool main_menu)
+{
+    menu_t *m;
+    item_t *item;
+
+    if (!main_menu)
+        image_object(image, menu, sizeof(*menu));
+
+    image_string(image, &menu->prompt);
+    image_expr(image, &menu->dependency);
+    image_list(image, &menu->entries);
+    image_list(image, &menu->childs);
+    image_list(image, &menu->sibling);
+
+    LIST_FOREACH(m, &menu->childs, sibling) {
+        image_menu(image, m, false);
+    }
+
+    LIST_FOREACH(item, &menu->entries, node) {
+        image_item(image, item);
+    }
+}
+
+static void image_db(struct image *image, struct db *db)
+{
+    struct include *file;
+    struct mapping *map;
+    unsigned int i;
+
+    image_object(image, db, sizeof(*db));
+    image_menu(image, &db->main_menu, true);
+    image_pointer(image, &db->curr_menu);
+
+    image_list(image, &db->files);
+    LIST_FOREACH(file, &db->files, node) {
+        image_object(image, file, sizeof(*file));
+        image_string(image, &file->file);
+        image_pointer(image, &file->menu);
+        image_list(image, &file->node);
+    }
+
+    image_list(image, &db->symtable);
+
+    image_pointer(image, &db->symtab.symbols);
+    if (db->symtab.symbols != NULL) {
+        image_object(image, db->symtab.symbols,
+            nr_symbols(&db->symtab) * sizeof(struct symbol));
+
+        for (i = 0; i < nr_symbols(&db->symtab); i++) {
+            image_string(image, &db->symtab.symbols[i].name);
+            image_pointer(image, &db->symtab.symbols[i].item);
+        }
+    }
+
+    image_pointer(image, &db->symtab.slots);
+    if (db->symtab.slots != NULL)
+        image_object(image, db->symtab.slots,
+            (db->symtab.mask + 1) * sizeof(symbol_t));
+
+    image_codes(image, db);
+
+    image_pointer(image, &db->eval_order);
+    if (db->eval_order != NULL) {
+        image_object(image, db->eval_order, db->nr_items * sizeof(item_t *));
+
+        for (i = 0; i < db->nr_items; i++)
+            image_pointer(image, &db->eval_order[i]);
+    }
+
+    image_pointer(image, &db->select_order);
+    if (db->select_order != NULL) {
+        image_object(image, db->select_order, db->nr_items * sizeof(item_t *));
+
+        for (i = 0; i < db->nr_items; i++)
+            image_pointer(image, &db->select_order[i]);
+    }
+
+    /* ... paths of the files in the cache key. */
+    for (map = db->mappings; map != NULL; map = map->next) {
+        if (map->file != NULL)
+            image_object(image, map->file, strlen(map->file) + 1);
+    }
+}
+
+static int object_cmp(const void *a, const void *b)
+{
+    const struct image_object *obj1 = a, *obj2 = b;
+
+    if (obj1->addr != obj2->addr)
+        return (obj1->addr < obj2->addr) ? -1 : 1;
+
+    return 0;
+}
+
+static int build_image(struct image *image, struct db *db)
+{
+    size_t i, n;
+
+    image->pass = 1;
+    image_db(image, db);
+
+    if (image->failed)
+        return -1;
+
+    /* Sort objects and merge duplicates, i.e. shared strings. */
+
+    qsort(image->objects, image->nr_objects, sizeof(struct image_object),
+        object_cmp);
+
+    for (i = 0, n = 0; i < image->nr_objects; i++) {
+        struct image_object *obj = &image->objects[i];
+
+        if ((n > 0) && (obj->addr < image->objects[n - 1].addr +
+                image->objects[n - 1].size)) {
+            struct image_object *last = &image->objects[n - 1];
+
+            if (obj->addr + obj->size > last->addr + last->size)
+                last->size = obj->addr + obj->size - last->addr;
+
+            continue;
+        }
+
+        image->objects[n++] = *obj;
+    }
+
+    image->nr_objects = n;
+
+    for (i = 0; i < image->nr_objects; i++) {
+        image->objects[i].offset = image->size;
+        image->size += (image->objects[i].size + CACHE_ALIGN - 1) &
+            ~(CACHE_ALIGN - 1);
+    }
+
+    if ((image->data = calloc(1, image->size + 1)) == NULL)
+        return -1;
+
+    image->pass = 2;
+    image_db(image, db);
+
+    return image->failed ? -1 : SUCCESS;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+    ssize_t n;
+
+    while (size > 0) {
+        if ((n = write(fd, p, size)) == -1)
+            return -1;
+
+        p += n;
+        size -= n;
+    }
+
+    return SUCCESS;
+}
+
+/* Save the linked database 'db' before any change to its state, i.e. right
+ * after 'link_db'; 'root' is the main configuration file. The cache is
+ * replaced atomically. */
+int save_cache(struct db *db, const char *filename, const char *root)
+{
+    struct image image = { 0 };
+    struct cache_header header = { .magic = CACHE_MAGIC };
+    struct cache_file *files = NULL;
+    struct mapping *map;
+    char *tmpname;
+    int fd = -1, ret = -1;
+    size_t n = 0;
+
+    static const char pad[CACHE_ALIGN];
+
+    if (build_image(&image, db) == -1) {
+        error_print("building image failed.\n");
+        goto out;
+    }
+
+    for (map = db->mappings; map != NULL; map = map->next)
+        n += (map->file != NULL);
+
+    if ((files = calloc(n + 1, sizeof(struct cache_file))) == NULL)
+        goto out;
+
+    for (map = db->mappings, n = 0; map != NULL; map = map->next) {
+        if (map->file == NULL)
+            continue;
+
+        files[n].path = image_offset(&image, map->file);
+        files[n].mtime = map->mtime;
+        files[n].size = map->file_size;
+        files[n++].hash = map->hash;
+    }
+
+    header.version = CACHE_VERSION;
+    header.sizeof_db = sizeof(struct db);
+    header.sizeof_item = sizeof(item_t);
+    header.sizeof_menu = sizeof(menu_t);
+    header.nr_files = n;
+    header.nr_relocs = image.nr_relocs;
+    header.root_size = strlen(root) + 1;
+    header.image = sizeof(header) + n * sizeof(struct cache_file) +
+        image.nr_relocs * sizeof(unsigned long) + header.root_size;
+    header.image = (header.image + CACHE_ALIGN - 1) & ~(CACHE_ALIGN - 1);
+    header.image_size = image.size;
+    header.db = image_offset(&image, db);
+
+    tmpname = alloca(strlen(filename) + 8);
+    sprintf(tmpname, "%s.XXXXXX", filename);
+
+    if ((fd = mkstemp(tmpname)) == -1)
+        goto out;
+
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    if ((write_all(fd, &header, sizeof(header)) == -1) ||
+        (write_all(fd, files, n * sizeof(struct cache_file)) == -1) ||
+        (write_all(fd, image.relocs,
+                image.nr_relocs * sizeof(unsigned long)) == -1) ||
+        (write_all(fd, root, header.root_size) == -1) ||
+        (write_all(fd, pad, header.image - sizeof(header) -
+                n * sizeof(struct cache_file) -
+                image.nr_relocs * sizeof(unsigned long) -
+                header.root_size) == -1) ||
+        (write_all(fd, image.data, image.size) == -1) ||
+        (close(fd) == -1) || (rename(tmpname, filename) == -1)) {
+        unlink(tmpname);
+        goto out;
+    }
+
+    ret = SUCCESS;
+
+out:
+    free(image.objects);
+    free(image.relocs);
+    free(image.data);
+    free(files);
+
+    return ret;
+}
+
+/* 'file' is not changed if it has the same size and mtime or content. */
+static bool file_unchanged(struct cache_file *file, const char *path)
+{
+    struct stat st;
+    void *addr;
+    bool ret;
+    int fd;
+
+    if ((stat(path, &st) == -1) || (st.st_size < 0) ||
+        ((size_t)st.st_size != file->size))
+        return false;
+
+    if ((st.st_mtim.tv_sec == file->mtime.tv_sec) &&
+        (st.st_mtim.tv_nsec == file->mtime.tv_nsec))
+        return true;
+
+    if (st.st_size == 0)
+        return (file->hash == cache_hash(NULL, 0));
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return false;
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED)
+        return false;
+
+    ret = (cache_hash(addr, st.st_size) == file->hash);
+    munmap(addr, st.st_size);
+
+    return ret;
+}
+
+/* Move a list from 'old' head to 'head'. */
+static void move_list(LIST_HEAD *old, LIST_HEAD *head)
+{
+    if (old->next == old) {
+        INIT_LIST_HEAD(head);
+        return;
+    }
+
+    *head = *old;
+    head->next->prev = head;
+    head->prev->next = head;
+}
+
+/* Move the relocated database 'cached' to 'db', initialised with 'init_db';
+ * 'addr' is the mapping of the image, it is unmapped with 'release_db'. */
+static int install_db(struct db *db, struct db *cached, char *addr,
+    size_t size)
+{
+    struct include *file;
+    struct mapping *map;
+    struct symbol *symbols = NULL;
+    symbol_t *slots = NULL;
+
+    /* ... values are not in the image, 'cached' has the defaults. */
+
+    cached->values = (struct values) VALUES_INIT;
+    cached->strings = (struct symtab) SYMTAB_INIT;
+
+    if (init_values(cached) == -1) {
+        sym_release(&cached->strings);
+        return -1;
+    }
+
+    /* ... the symbol table is private to 'db', so it can grow. */
+
+    if ((cached->symtab.symbols != NULL) &&
+        ((symbols = malloc(nr_symbols(&cached->symtab) *
+                    sizeof(struct symbol))) == NULL))
+        goto failed;
+
+    if ((cached->symtab.slots != NULL) &&
+        ((slots = malloc((cached->symtab.mask + 1) *
+                    sizeof(symbol_t))) == NULL))
+        goto failed;
+
+    if ((map = arena_alloc(&db->node_arena, sizeof(*map))) == NULL)
+        goto failed;
+
+    if (symbols != NULL) {
+        memcpy(symbols, cached->symtab.symbols,
+            nr_symbols(&cached->symtab) * sizeof(struct symbol));
+
+        db->symtab.symbols = symbols;
+        db->symtab.nr_symbols = db->symtab.max_symbols =
+            nr_symbols(&cached->symtab);
+    }
+
+    if (slots != NULL) {
+        memcpy(slots, cached->symtab.slots,
+            (cached->symtab.mask + 1) * sizeof(symbol_t));
+
+        db->symtab.slots = slots;
+        db->symtab.mask = cached->symtab.mask;
+    }
+
+    /* ... the evaluation state is not in the image. */
+
+    db->nr_items = cached->nr_items;
+    db->nr_codes = cached->nr_codes;
+
+    if (init_eval(db) == -1) {
+        db->symtab = (struct symtab) SYMTAB_INIT;
+        goto failed;
+    }
+
+    /* Copy the database and move lists that start in 'cached'. */
+
+    move_list(&cached->main_menu.entries, &db->main_menu.entries);
+    move_list(&cached->main_menu.childs, &db->main_menu.childs);
+    move_list(&cached->files, &db->files);
+    move_list(&cached->symtable, &db->symtable);
+
+    LIST_FOREACH(file, &db->files, node) {
+        if (file->menu == &cached->main_menu)
+            file->menu = &db->main_menu;
+    }
+
+    db->codes = cached->codes;
+    db->eval_order = cached->eval_order;
+    db->select_order = cached->select_order;
+    db->values = cached->values;
+    db->strings = cached->strings;
+
+    map->addr = addr;
+    map->size = size;
+    map->file = NULL;
+    map->next = db->mappings;
+    db->mappings = map;
+
+    return SUCCESS;
+
+failed:
+    error_print("''alloc'' failed.\n");
+
+    free(symbols);
+    free(slots);
+    release_values(&cached->values);
+    sym_release(&cached->strings);
+
+    return -1;
+}
+
+/* Load the cache to 'db', initialised with 'init_db'. Returns -1 if there
+ * is no valid cache of the main configuration file 'root' for the current
+ * files. */
+int load_cache(struct db *db, const char *filename, const char *root)
+{
+    struct cache_header *header;
+    struct cache_file *files;
+    unsigned long *relocs, i;
+    struct stat st;
+    char *addr, *image, *name;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) == -1)
+        return -1;
+
+    if ((fstat(fd, &st) == -1) || (st.st_size < 0) ||
+        ((size_t)st.st_size < sizeof(*header))) {
+        close(fd);
+        return -1;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED)
+        return -1;
+
+    header = (struct cache_header *)addr;
+
+    if ((memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0) ||
+        (header->version != CACHE_VERSION) ||
+        (header->sizeof_db != sizeof(struct db)) ||
+        (header->sizeof_item != sizeof(item_t)) ||
+        (header->sizeof_menu != sizeof(menu_t)) ||
+        (header->image + header->image_size != (size_t)st.st_size) ||
+        (header->db + sizeof(struct db) > header->image_size))
+        goto stale;
+
+    files = (struct cache_file *)(header + 1);
+    relocs = (unsigned long *)(files + header->nr_files);
+    name = (char *)(relocs + header->nr_relocs);
+    image = addr + header->image;
+
+    /* ... of another main configuration file in the same directory. */
+    if ((name + header->root_size > image) ||
+        (header->root_size != strlen(root) + 1) ||
+        (memcmp(name, root, header->root_size) != 0))
+        goto stale;
+
+    for (i = 0; i < header->nr_files; i++) {
+        if (!file_unchanged(&files[i], image + files[i].path))
+            goto stale;
+    }
+
+    for (i = 0; i < header->nr_relocs; i++)
+        *(uintptr_t *)(image + relocs[i]) += (uintptr_t)image;
+
+    if (install_db(db, (struct db *)(image + header->db), addr,
+            st.st_size) == 0)
+        return SUCCESS;
+
+stale:
+    munmap(addr, st.st_size);
+
+    return -1;
+}
@@ -9,6 +9,8 @@
 #include <unistd.h>
 #include <stdbool.h>
 
+#include "symtab.h"
+
 typedef char *string_t;
 
 typedef struct {
@@ -21,10 +23,12 @@ typedef struct {
         bool boolean;
         integer_t number;
         string_t string;
+        symbol_t symbol;        /* 'TT_SYMBOL' tokens carry only the ID. */
     } info;
 #define TK_BOOL info.boolean
 #define TK_INTEGER info.number.n
 #define TK_STRING info.string
+#define TK_SYMBOL info.symbol
 } token_t;
 
 enum expr_op {
@@ -36,9 +40,12 @@ enum expr_op {
     OP_NOT
 };
 
+struct bytecode;
+
 typedef struct expr *expr_t;
 struct expr {
     enum expr_op op;
+    struct bytecode *code;      /* Compiled expression, set on the root. */
     struct {
         union {
             token_t token;
@@ -1,25 +1,35 @@
-%{
+%code requires {
 
 #include "config.parser.h"
 #include "db.h"
 
-extern void yyerror(char *s);
-extern int yylex (void);
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
 
-extern int push_menu(token_t, expr_t);
-extern int pop_menu(void);
+}
+
+%code {
+
+extern int yylex(YYSTYPE *, yyscan_t);
+extern void yyerror(struct db *, yyscan_t, const char *);
 
-extern expr_t add_expr_op(enum expr_op, ...);
+extern int push_menu(struct db *, token_t, expr_t);
+extern int pop_menu(struct db *);
+
+extern expr_t add_expr_op(struct db *, enum expr_op, ...);
 #define yy_add_expr_op(op, ...) ({                      \
-    expr_t __tmp = add_expr_op((op), __VA_ARGS__);      \
+    expr_t __tmp = add_expr_op(db, (op), __VA_ARGS__);  \
     if (__tmp == NULL)                                  \
         YYERROR;                                        \
     (__tmp);                                            \
 })
 
-extern struct token_list *next_token(struct token_list *, unsigned long, ...);
+extern struct token_list *next_token(struct db *, struct token_list *,
+    unsigned long, ...);
 #define __yy_next_token(token1, flags, ...) ({          \
-    struct token_list *__tmp = next_token((token1),     \
+    struct token_list *__tmp = next_token(db, (token1), \
         (flags), __VA_ARGS__);                          \
     if (__tmp == NULL)                                  \
         YYERROR;                                        \
@@ -33,15 +43,22 @@ extern struct token_list *next_token(struct token_list *, unsigned long, ...);
     __yy_next_token((t), __flags, (sym), (cond));       \
 })
 
-extern int add_new_config_entry(token_t, token_t, token_t, struct token_list *, expr_t, token_t);
-extern int add_new_choice_entry(token_t, token_t, struct token_list *, expr_t, token_t);
-extern int add_new_config_file(token_t);
+extern int add_new_config_entry(struct db *, token_t, token_t, token_t,
+    struct token_list *, expr_t, token_t);
+extern int add_new_choice_entry(struct db *, token_t, token_t,
+    struct token_list *, expr_t, token_t);
+extern int add_new_config_file(struct db *, token_t);
 
 #define NULLDESC (token_t) {                            \
     .ttype = TT_DESCRIPTION, .TK_STRING = NULL          \
 }
 
-%}
+}
+
+/* ... parser state lives in 'db', so files can be parsed independently. */
+%define api.pure full
+%parse-param {struct db *db} {yyscan_t scanner}
+%lex-param {yyscan_t scanner}
 
 %union
 {
@@ -103,13 +120,13 @@ stmt_line: /* ... main entry to the grammer. */
 
 menu_start: MENU TT_DESCRIPTION dependency
 {
-    if (push_menu($2, $3) == -1)
+    if (push_menu(db, $2, $3) == -1)
         YYERROR;
 };
 
 menu_end: END
 {
-    if(pop_menu() == -1)
+    if(pop_menu(db) == -1)
         YYERROR;
 };
 
@@ -163,7 +180,7 @@ config_type: BOOL   { $$ = (token_t)  {
 stmt_config: CONFIG config_description TT_SYMBOL
         config_type config_selects dependency help
 {
-    if (add_new_config_entry($2, $3,
+    if (add_new_config_entry(db, $2, $3,
             $4, $5, $6, $7) == -1)
         YYERROR;
 };
@@ -202,7 +219,7 @@ choice_options:
 stmt_choice: CHOICE TT_DESCRIPTION TT_SYMBOL
         choice_options dependency help
 {
-    if (add_new_choice_entry($2, $3,
+    if (add_new_choice_entry(db, $2, $3,
             $4, $5, $6) == -1)
         YYERROR;
 };
@@ -211,7 +228,7 @@ stmt_choice: CHOICE TT_DESCRIPTION TT_SYMBOL
 
 stmt_include: INCLUDE TT_DESCRIPTION
 {
-    if (add_new_config_file($2) == -1)
+    if (add_new_config_file(db, $2) == -1)
         YYERROR;
 };
 
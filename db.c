@@ -2,60 +2,206 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdarg.h>
 #include <fcntl.h>
-#include <search.h>
+#include <errno.h>
 
 #include "db.h"
+#include "trace.h"
 #include "defaults.h"
 #include "y.tab.h"
 
-#define alloc(t) malloc(sizeof(t))
+#define alloc(t) arena_alloc(&db->node_arena, sizeof(t))
 
-menu_t main_menu = {
-    NULL,
-    NULL,
-    LIST_HEAD_INIT(main_menu.entries),
-    LIST_HEAD_INIT(main_menu.childs),
-    LIST_HEAD_INIT(main_menu.sibling)
-};
+void init_db(struct db *db)
+{
+    db->main_menu.prompt = NULL;
+    db->main_menu.dependency = NULL;
+    INIT_LIST_HEAD(&db->main_menu.entries);
+    INIT_LIST_HEAD(&db->main_menu.childs);
+    INIT_LIST_HEAD(&db->main_menu.sibling);
+
+    db->curr_menu = &db->main_menu;
+    db->tree = db;
+
+    INIT_LIST_HEAD(&db->files);
+    INIT_LIST_HEAD(&db->symtable);
+
+    db->symtab = (struct symtab) SYMTAB_INIT;
+    db->fragment = false;
+    db->node_arena = (struct arena) ARENA_INIT;
+    db->string_arena = (struct arena) ARENA_INIT;
+    db->mappings = NULL;
+
+    db->codes = NULL;
+    db->nr_codes = 0;
+    db->eval_order = db->eval_queue = NULL;
+    db->nr_items = db->nr_queued = 0;
+    db->queued = NULL;
+    db->results = NULL;
+    db->generation = 1;
+    db->eval_generation = 0;
+    db->select_order = db->select_queue = NULL;
+    db->values = (struct values) VALUES_INIT;
+    db->strings = (struct symtab) SYMTAB_INIT;
+}
+
+/* Release the whole database, it is ready for another 'yy_parse_file'. */
+void release_db(struct db *db)
+{
+    struct mapping *map;
+
+    for (map = db->mappings; map != NULL; map = map->next)
+        munmap(map->addr, map->size);
+
+    arena_release(&db->node_arena);
+    arena_release(&db->string_arena);
+    release_values(&db->values);
+    sym_release(&db->strings);
+
+    /* ... the symbol table of a view is of its tree. */
+    if (db->tree == db)
+        sym_release(&db->symtab);
+
+    init_db(db);
+}
 
-menu_t *curr_menu = &main_menu;
+/* Make 'view' a database of the linked tree of 'db', with the values of
+ * 'db'; The tree is only read, so views can be used on other threads, e.g.
+ * by workers of 'batch.c'. 'db' is evaluated, its values are not written
+ * and it is released after its views. */
+int share_db(struct db *view, struct db *db)
+{
+    unsigned int i;
+
+    init_db(view);
+
+    view->tree = db->tree;
+    view->symtab = db->symtab;
+    view->codes = db->codes;
+    view->nr_codes = db->nr_codes;
+    view->eval_order = db->eval_order;
+    view->nr_items = db->nr_items;
+    view->select_order = db->select_order;
+
+    /* ... strings are interned in order, so values keep their indexes. */
+    for (i = 0; i < nr_symbols(&db->strings); i++) {
+        if (intern_string(view, sym_name(&db->strings, i)) == -1)
+            return -1;
+    }
 
-LIST_HEAD files = LIST_HEAD_INIT(files);
-LIST_HEAD symtable = LIST_HEAD_INIT(symtable);
+    if ((share_values(&view->values, &db->values) == -1) ||
+        (init_eval(view) == -1))
+        return -1;
 
-static item_t *hash_get_item(string_t symbol)
+    /* ... values of 'db' are evaluated, already. */
+    reset_eval(view);
+
+    return SUCCESS;
+}
+
+/* Unmap the files mapped after 'map', e.g. '.old.config' files loaded since;
+ * Values do not point into them, strings are interned, see 'values.c'. */
+void unmap_files(struct db *db, struct mapping *map)
 {
-    ENTRY entry = { symbol, NULL };
-    ENTRY *found_entry = hsearch(entry, FIND);
+    struct mapping *m;
 
-    if (found_entry != NULL)
-        return (item_t *) (found_entry->data);
+    while ((m = db->mappings) != map) {
+        db->mappings = m->next;
+        munmap(m->addr, m->size);
+    }
+}
+
+/* Map 'filename' to memory, followed by two zero bytes as 'yy_scan_buffer'
+ * expects; The mapping is private and writable, so strings can be terminated
+ * in place and nothing is written back to the file. It is unmapped with
+ * 'release_db'. */
+static struct mapping *map_file(struct db *db, const char *filename)
+{
+    struct mapping *map;
+    struct stat st;
+    char *addr;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) == -1)
+        return NULL;
+
+    if ((fstat(fd, &st) == -1) || ((map = alloc(struct mapping)) == NULL))
+        goto failed;
+
+    map->size = st.st_size + 2;
+    map->file = NULL;
+    map->mtime = st.st_mtim;
+    map->file_size = st.st_size;
+
+    /* ... reserve zero-filled pages, then map the file over the start. */
+
+    if ((addr = mmap(NULL, map->size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        goto failed;
+
+    if ((st.st_size > 0) && (mmap(addr, st.st_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+        munmap(addr, map->size);
+        goto failed;
+    }
+
+    close(fd);
+
+    map->addr = addr;
+    map->next = db->mappings;
+    db->mappings = map;
+
+    return map;
+
+failed:
+    close(fd);
 
     return NULL;
 }
 
-static int hash_add_item(item_t *item, string_t symbol)
+/* Map a configuration file; The scanner terminates strings in place and
+ * 'TT_DESCRIPTION' tokens point into the mapping. */
+char *map_config_file(struct db *db, const char *filename, size_t *size)
 {
-    ENTRY entry = { symbol, item };
+    struct mapping *map;
 
-    if (hash_get_item(symbol) != NULL) {
-        error_print("%s symbol exists.\n", symbol);
-        return -1;
+    if ((map = map_file(db, filename)) == NULL)
+        return NULL;
+
+    /* ... it is a key to the binary cache. */
+    map->file = filename;
+    map->hash = cache_hash(map->addr, map->file_size);
+
+    *size = map->size;
+
+    return map->addr;
+}
+
+static int hash_add_item(struct db *db, item_t *item, symbol_t symbol)
+{
+    /* ... a fragment does not know the symbols defined in other files, so
+     * duplicates are reported when merged, in order of definition. */
+
+    if (db->fragment) {
+        LIST_INSERT_TAIL(&item->sym_node, &db->symtable);
+        return SUCCESS;
     }
 
-    if (hsearch(entry, ENTER) == NULL) {
-        error_print("''symtable'' is full.\n");
+    if (hash_get_item(db, symbol) != NULL) {
+        error_print("%s symbol exists.\n", sym_name(&db->symtab, symbol));
         return -1;
     }
 
-    LIST_INSERT_TAIL(&item->sym_node, &symtable);
+    sym_get(&db->symtab, symbol)->item = item;
+    item->id = symbol;
+    LIST_INSERT_TAIL(&item->sym_node, &db->symtable);
 
     return SUCCESS;
 }
 
-int push_menu(token_t token, expr_t expr)
+int push_menu(struct db *db, token_t token, expr_t expr)
 {
     menu_t *menu = alloc(menu_t);
 
@@ -70,22 +216,22 @@ int push_menu(token_t token, expr_t expr)
     INIT_LIST_HEAD(&menu->childs);
     INIT_LIST_HEAD(&menu->sibling);
 
-    LIST_INSERT_TAIL(&menu->sibling, &curr_menu->childs);
+    LIST_INSERT_TAIL(&menu->sibling, &db->curr_menu->childs);
 
-    curr_menu = menu;
+    db->curr_menu = menu;
 
     return SUCCESS;
 }
 
-int pop_menu(void)
+int pop_menu(struct db *db)
 {
     /* 'curr_menu' is tail of current menu. */
-    curr_menu = container_of(curr_menu->sibling.next, menu_t, childs);
+    db->curr_menu = container_of(db->curr_menu->sibling.next, menu_t, childs);
 
     return SUCCESS;
 }
 
-struct token_list *next_token(struct token_list *token1,
+struct token_list *next_token(struct db *db, struct token_list *token1,
     unsigned long flags, ...)
 {
     struct extended_token *et;
@@ -97,23 +243,13 @@ struct token_list *next_token(struct token_list *token1,
         et->flags = flags;
         et->condition = NULL;
 
-        if (flags == TK_LIST_EF_NULL) {
-
-            /* It is an entry in the list for 'select' keyword or a standard
-             * (i.e. it is not default) option for 'choice' keyword.
-             */
-
-            et->token = va_arg(va, token_t);
+        /* It is an entry in the list for 'select' keyword, an option for
+         * 'choice' keyword (i.e. 'TK_LIST_EF_DEFAULT' is set for the default
+         * option) or the configuration token, all have a token. Conditional
+         * options have the condition after the token.
+         */
 
-        }
-
-        if (flags & TK_LIST_EF_DEFAULT) {
-
-            /* TODO. Check if there is any conditional token in the list. */
-
-            /* It is the default option for 'choice' keyword. */
-            et->token = va_arg(va, token_t);
-        }
+        et->token = va_arg(va, token_t);
 
         if (flags & TK_LIST_EF_CONDITIONAL) {
 
@@ -134,19 +270,19 @@ struct token_list *next_token(struct token_list *token1,
     return token1;
 }
 
-static inline int init_entry(struct item_shared *entry,
+static inline int init_entry(struct db *db, struct item_shared *entry,
     token_t prompt, token_t symbol, token_t help, expr_t expr)
 {
 
     entry->prompt = prompt.TK_STRING;
-    entry->symbol = symbol.TK_STRING;
+    entry->symbol = sym_name(&db->symtab, symbol.TK_SYMBOL);
     entry->dependency = expr;
     entry->help = help.TK_STRING;
 
     return SUCCESS;
 }
 
-int add_new_config_entry(token_t token1, token_t token2,
+int add_new_config_entry(struct db *db, token_t token1, token_t token2,
     token_t token3, struct token_list *token4, expr_t expr, token_t token5)
 {
     /* Restrict 'select' keyword to only 'TT_BOOL'. */
@@ -162,26 +298,26 @@ int add_new_config_entry(token_t token1, token_t token2,
 
     INIT_LIST_HEAD(&item->node);
     INIT_LIST_HEAD(&item->sym_node);
-    init_entry(&item->common, token1, token2, token5, expr);
+    init_entry(db, &item->common, token1, token2, token5, expr);
+
+    item->readers = NULL;
+    item->nr_readers = 0;
 
     /* Store 'token3' at the head as 'TK_LIST_EF_CONFIG'. */
     if ((item->tk_list =
-                next_token(token4, (TK_LIST_EF_CONFIG | TK_LIST_EF_DEFAULT),
-                    token3)) == NULL)
+                next_token(db, token4,
+                    (TK_LIST_EF_CONFIG | TK_LIST_EF_DEFAULT), token3)) == NULL)
         return -1;
 
-    item->refcount = 0;
-    LIST_INSERT_TAIL(&item->node, &curr_menu->entries);
+    LIST_INSERT_TAIL(&item->node, &db->curr_menu->entries);
 
-    if (hash_add_item(item, token2.TK_STRING) == -1) {
-        error_print("%s symbol exists.\n", token2.TK_STRING);
+    if (hash_add_item(db, item, token2.TK_SYMBOL) == -1)
         return -1;
-    }
 
     return SUCCESS;
 }
 
-int add_new_choice_entry(token_t token1, token_t token2,
+int add_new_choice_entry(struct db *db, token_t token1, token_t token2,
     struct token_list *token3, expr_t expr, token_t token4)
 {
     item_t *item = alloc(item_t);
@@ -193,20 +329,21 @@ int add_new_choice_entry(token_t token1, token_t token2,
 
     INIT_LIST_HEAD(&item->node);
     INIT_LIST_HEAD(&item->sym_node);
-    init_entry(&item->common, token1, token2, token4, expr);
+    init_entry(db, &item->common, token1, token2, token4, expr);
+
+    item->readers = NULL;
+    item->nr_readers = 0;
 
     item->tk_list = token3;
-    LIST_INSERT_TAIL(&item->node, &curr_menu->entries);
+    LIST_INSERT_TAIL(&item->node, &db->curr_menu->entries);
 
-    if (hash_add_item(item, token2.TK_STRING) == -1) {
-        error_print("%s symbol exists.\n", token2.TK_STRING);
+    if (hash_add_item(db, item, token2.TK_SYMBOL) == -1)
         return -1;
-    }
 
     return SUCCESS;
 }
 
-int add_new_config_file(token_t token1)
+int add_new_config_file(struct db *db, token_t token1)
 {
     struct include *file = alloc(struct include);
 
@@ -216,13 +353,13 @@ int add_new_config_file(token_t token1)
     }
 
     file->file = token1.TK_STRING;
-    file->menu = curr_menu;
-    LIST_INSERT_TAIL(&file->node, &files);
+    file->menu = db->curr_menu;
+    LIST_INSERT_TAIL(&file->node, &db->files);
 
     return SUCCESS;
 }
 
-expr_t add_expr_op(enum expr_op op, ...)
+expr_t add_expr_op(struct db *db, enum expr_op op, ...)
 {
     va_list va;
     expr_t expr = alloc(struct expr);
@@ -252,233 +389,354 @@ expr_t add_expr_op(enum expr_op op, ...)
         break;
 
     default:
-        free(expr);
-
         expr = NULL;
     }
 
-    if (expr != NULL)
+    if (expr != NULL) {
         expr->op = op;
+        expr->code = NULL;      /* ... see 'link_db'. */
+    }
 
     va_end(va);
 
     return expr;
 }
 
-static token_t hash_get_token(string_t symbol)
+static void remap_token(token_t *token, const symbol_t *remap)
 {
-    struct extended_token *et;
-    item_t *item = hash_get_item(symbol);
-
-    if ((item != NULL) && eval_expr(item->common.dependency)) {
-        item_token_list_for_each_entry(et, item) {
-            if (et->flags & (TK_LIST_EF_CONFIG | TK_LIST_EF_SELECTED))
-                return et->token;
-        }
-    }
-
-    return ((token_t) {
-        .ttype = TT_INVALID
-    });
+    if (token->ttype == TT_SYMBOL)
+        token->TK_SYMBOL = remap[token->TK_SYMBOL];
 }
 
-static bool __eval_expr(token_t token1, token_t token2, enum expr_op op)
+static void remap_expr(expr_t expr, const symbol_t *remap)
 {
-    switch (token1.ttype) {
-    case TT_BOOL:
-        if (op == OP_EQUAL)
-            return (token1.TK_BOOL == token2.TK_BOOL);
+    if (expr == NULL)
+        return;
 
-        if (op == OP_NEQUAL)
-            return (token1.TK_BOOL != token2.TK_BOOL);
+    switch (expr->op) {
+    case OP_EQUAL:
+    case OP_NEQUAL:
+        remap_token(&expr->LEFT.token, remap);
 
+    case OP_NULL:
+        remap_token(&expr->RIGHT.token, remap);
         break;
 
-    case TT_INTEGER:
-        if (op == OP_EQUAL)
-            return (token1.TK_INTEGER == token2.TK_INTEGER);
-
-        if (op == OP_NEQUAL)
-            return (token1.TK_INTEGER != token2.TK_INTEGER);
+    case OP_AND:
+    case OP_OR:
+        remap_expr(expr->LEFT.expr, remap);
 
+    case OP_NOT:
+        remap_expr(expr->RIGHT.expr, remap);
         break;
+    }
+}
 
-    case TT_DESCRIPTION:
-        if (op == OP_EQUAL)
-            return (strcmp(token1.TK_STRING, token2.TK_STRING) == 0);
-
-        if (op == OP_NEQUAL)
-            return (strcmp(token1.TK_STRING, token2.TK_STRING) != 0);
+static void remap_menu(menu_t *menu, const symbol_t *remap)
+{
+    menu_t *m;
+    item_t *item;
+    struct extended_token *et;
 
-        break;
+    remap_expr(menu->dependency, remap);
 
-    default:
-        debug_print("Unable to compute 'expr'.\n");
+    LIST_FOREACH(m, &menu->childs, sibling) {
+        remap_menu(m, remap);
     }
 
-    return false;
+    LIST_FOREACH(item, &menu->entries, node) {
+        remap_expr(item->common.dependency, remap);
+
+        item_token_list_for_each_entry(et, item) {
+            remap_token(&et->token, remap);
+            remap_expr(et->condition, remap);
+        }
+    }
 }
 
-bool eval_expr(expr_t expr)
+/* Merge 'fragment' to 'db' as if its file was parsed in 'menu' right after
+ * the files merged before; Symbols are interned in the same order and the
+ * duplicates are reported as 'yy_parse_file' does. */
+int merge_fragment(struct db *db, struct db *fragment, menu_t *menu)
 {
-    token_t token, token1, token2;
+    LIST_HEAD *node, *next;
+    struct include *file;
+    struct mapping *map;
+    symbol_t id, *remap;
+    int ret = -1;
+
+    if ((remap = malloc((nr_symbols(&fragment->symtab) + 1) *
+                sizeof(symbol_t))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
 
-    /* No 'depends' keyword, always success. */
-    if (expr == NULL)
-        return true;
+    /* ... nodes are owned by 'db', even if merge fails half way. */
 
-    switch (expr->op) {
-    case OP_NULL:
-        token = expr->NODE.token;
+    arena_splice(&db->node_arena, &fragment->node_arena);
+    arena_splice(&db->string_arena, &fragment->string_arena);
 
-        if (token.ttype == TT_SYMBOL) {
-            token = hash_get_token(token.TK_STRING);
+    while ((map = fragment->mappings) != NULL) {
+        fragment->mappings = map->next;
+        map->next = db->mappings;
+        db->mappings = map;
+    }
 
-            if ((token.ttype == TT_INVALID) || (token.ttype != TT_BOOL)) {
-                debug_print("Broken dependency: %s.\n", token.TK_STRING);
-                break;
-            }
-        } else
-            break;
+    for (id = 0; id < nr_symbols(&fragment->symtab); id++) {
+        string_t name = sym_name(&fragment->symtab, id);
 
-        return token.TK_BOOL;
+        if ((remap[id] = sym_intern(&db->symtab, name, strlen(name))) ==
+            SYM_INVALID)
+            goto out;
+    }
 
-    case OP_EQUAL:
-    case OP_NEQUAL:
-        /* Use 'LEFT' and 'RIGHT' tokens. */
-        token1 = expr->LEFT.token;
-        token2 = expr->RIGHT.token;
+    remap_menu(&fragment->main_menu, remap);
 
-        if (token1.ttype == TT_SYMBOL) {
-            token1 = hash_get_token(token1.TK_STRING);
+    for (node = fragment->symtable.next; node != &fragment->symtable;
+        node = next) {
+        item_t *item = container_of(node, item_t, sym_node);
 
-            if (token1.ttype == TT_INVALID) {
-                debug_print("Broken dependency: %s.\n", token1.TK_STRING);
-                break;
-            }
-        }
+        next = node->next;
 
-        if (token2.ttype == TT_SYMBOL) {
-            token2 = hash_get_token(token2.TK_STRING);
+        id = sym_lookup(&db->symtab, item->common.symbol,
+                strlen(item->common.symbol));
+        item->common.symbol = sym_name(&db->symtab, id);
 
-            if (token2.ttype == TT_INVALID) {
-                debug_print("Broken dependency: %s.\n", token2.TK_STRING);
-                break;
-            }
-        }
+        if (hash_add_item(db, item, id) == -1)
+            goto out;
+    }
 
-        if (token1.ttype != token2.ttype) {
-            debug_print("Tokens are incompatible.\n");
-            break;
-        }
+    LIST_SPLICE_TAIL(&fragment->main_menu.entries, &menu->entries);
+    LIST_SPLICE_TAIL(&fragment->main_menu.childs, &menu->childs);
 
-        return __eval_expr(token1, token2, expr->op);
+    for (node = fragment->files.next; node != &fragment->files; node = next) {
+        file = container_of(node, struct include, node);
 
-    case OP_NOT:
-        return !eval_expr(expr->NODE.expr);
+        next = node->next;
 
-    case OP_OR:
-        return eval_expr(expr->LEFT.expr) || eval_expr(expr->RIGHT.expr);
+        if (file->menu == &fragment->main_menu)
+            file->menu = menu;
 
-    case OP_AND:
-        return eval_expr(expr->LEFT.expr) && eval_expr(expr->RIGHT.expr);
-
-    default:
-        return false;
+        LIST_INSERT_TAIL(&file->node, &db->files);
     }
 
-    return false;
+    /* ... the fragment is empty now. */
+
+    INIT_LIST_HEAD(&fragment->main_menu.entries);
+    INIT_LIST_HEAD(&fragment->main_menu.childs);
+    INIT_LIST_HEAD(&fragment->files);
+    INIT_LIST_HEAD(&fragment->symtable);
+
+    sym_release(&fragment->symtab);
+
+    ret = SUCCESS;
+
+out:
+    free(remap);
+
+    return ret;
 }
 
-int fprintf_menu(FILE *fp, menu_t *menu)
+int fprintf_menu(struct db *db, FILE *fp, menu_t *menu)
 {
     menu_t *m;
     item_t *item;
 
-    if (!eval_expr(menu->dependency))
+    if (!eval_expr(db, menu->dependency))
         return -1;
 
+    trace_begin("fprintf_menu", menu->prompt);
+
     /* Handle childs, first. */
     LIST_FOREACH(m, &menu->childs, sibling) {
-        fprintf_menu(fp, m);
+        fprintf_menu(db, fp, m);
     }
 
     LIST_FOREACH(item, &menu->entries, node) {
-        if (!eval_expr(item->common.dependency))
+        if (!eval_item(db, item))
             continue;
 
         struct extended_token *et;
+
+        if ((et = item_get_config_et(item)) != NULL) {
+            if (et->token.ttype == TT_BOOL) {
+
+                /* Assume 'false' as undefined symbol. */
+                if (item_bool(db, item))
+                    fprintf(fp, "#define %s y\n", item->common.symbol);
+
+            } else if (et->token.ttype == TT_INTEGER) {
+                fprintf(fp, "#define %s %d\n", item->common.symbol,
+                    item_data(db, item));
+
+            } else if (et->token.ttype == TT_DESCRIPTION) {
+                fprintf(fp, "#define %s \"%s\"\n", item->common.symbol,
+                    sym_name(&db->strings, item_data(db, item)));
+            }
+
+            continue;
+        }
+
+        /* There may be multiple options with the value of the choice. */
+
         item_token_list_for_each_entry(et, item) {
+            if (!option_selected(db, item, et) ||
+                !eval_expr(db, et->condition))
+                continue;
+
+            if (et->token.ttype == TT_INTEGER)
+                fprintf(fp, "#define %s %d\n", item->common.symbol,
+                    et->token.TK_INTEGER);
+            else
+                fprintf(fp, "#define %s \"%s\"\n", item->common.symbol,
+                    et->token.TK_STRING);
+        }
+    }
 
-            if (et->flags & (TK_LIST_EF_CONFIG | TK_LIST_EF_SELECTED)) {
-                if (et->token.ttype == TT_BOOL) {
+    trace_end();
 
-                    /* Assume 'false' as undefined symbol. */
-                    if (et->token.TK_BOOL == true)
-                        fprintf(fp, "#define %s y\n", item->common.symbol);
+    return SUCCESS;
+}
 
-                } else if (et->token.ttype == TT_INTEGER) {
+/* Replace 'filename' with 'data' unless it has the same contents already, so
+ * its mtime changes only if a value changes. The new file is written to a
+ * temporary file then renamed, so readers never see a partial file. If 'excl'
+ * is set, 'filename' must not exist. */
+int update_file(const char *filename, const char *data, size_t size,
+    mode_t mode, bool excl)
+{
+    struct stat st;
+    char *tmpname;
+    void *addr;
+    bool same;
+    int fd;
 
-                    /* There may be multiple options with 'TK_LIST_EF_SELECTED'. */
+    if (!excl && ((fd = open(filename, O_RDONLY)) != -1)) {
+        same = false;
 
-                    if (eval_expr(et->condition)) {
-                        fprintf(fp, "#define %s %d\n", item->common.symbol,
-                            et->token.TK_INTEGER);
-                    }
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+            ((size_t)st.st_size == size)) {
+            if (size == 0)
+                same = true;
 
-                } else if (et->token.ttype == TT_DESCRIPTION) {
-                    if (eval_expr(et->condition))
-                        fprintf(fp, "#define %s \"%s\"\n", item->common.symbol,
-                            et->token.TK_STRING);
-                }
+            else if ((addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+                            fd, 0)) != MAP_FAILED) {
+                same = (memcmp(addr, data, size) == 0);
+                munmap(addr, size);
             }
         }
 
+        close(fd);
+
+        if (same)
+            return SUCCESS;
+    }
+
+    tmpname = alloca(strlen(filename) + 32);
+    sprintf(tmpname, "%s.%d.tmp", filename, getpid());
+
+    if ((fd = open(tmpname, O_CREAT | O_WRONLY | O_TRUNC, mode)) == -1)
+        return -1;
+
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+
+        if (n == -1) {
+            close(fd);
+            goto failed;
+        }
+
+        data += n;
+        size -= n;
     }
 
+    if (close(fd) == -1)
+        goto failed;
+
+    /* ... 'link' does not replace an existing file. */
+    if (excl) {
+        if (link(tmpname, filename) == -1)
+            goto failed;
+
+        unlink(tmpname);
+
+    } else if (rename(tmpname, filename) == -1)
+        goto failed;
+
     return SUCCESS;
+
+failed:
+    fd = errno;
+    unlink(tmpname);
+    errno = fd;
+
+    return -1;
 }
 
-int __populate_config_file(const char *filename, unsigned long flags)
+void fprintf_autoconfig(struct db *db, FILE *fp)
 {
-    item_t *item;
-    struct extended_token *et;
-    FILE *fp;
+    fprintf(fp, "#ifndef __UCONFIG_H\n");
+    fprintf(fp, "#define __UCONFIG_H\n");
+    fprintf_menu(db, fp, &db->tree->main_menu);
+    fprintf(fp, "#endif /* __UCONFIG_H */\n");
+}
 
-    int fd;
+int build_autoconfig(struct db *db, const char *filename)
+{
+    FILE *fp;
+    char *data;
+    size_t size;
+    int ret;
 
-    if ((fd = open(filename, O_CREAT | O_WRONLY | O_TRUNC |
-                    /* ... file does not exist if dumping defaults. */
-                    ((flags & TK_LIST_EF_DEFAULT) ? O_EXCL : 0),
-                    S_IRUSR | S_IWUSR)) == -1)
+    if ((fp = open_memstream(&data, &size)) == NULL)
         return -1;
 
-    if ((fp = fdopen(fd, "w")) == NULL) {
-        close(fd);
-        return -1;
-    }
+    fprintf_autoconfig(db, fp);
+    fclose(fp);
+
+    ret = update_file(filename, data, size, AUTOCONFIG_MODE, false);
+    free(data);
+
+    return ret;
+}
+
+void fprintf_config_file(struct db *db, FILE *fp, unsigned long flags)
+{
+    item_t *item;
+    struct extended_token *et;
 
     fprintf(fp, "# THIS IS AN AUTO-GENERATED FILE: DO NOT EDIT.\n");
 
     /* Dump every items to 'fp' based on 'flags'. */
-    LIST_FOREACH(item, &symtable, sym_node) {
+    LIST_FOREACH(item, &db->tree->symtable, sym_node) {
 
         item_token_list_for_each_entry(et, item) {
-            if (et->flags & flags) {
-                switch (et->token.ttype) {
+            token_t token = et->token;
+            unsigned long et_flags = et->flags;
+
+            /* ... defaults are in the tree, current values in 'db->values'. */
+            if (!(flags & TK_LIST_EF_DEFAULT)) {
+                if (et_flags & TK_LIST_EF_CONFIG)
+                    token = item_get_token(db, item);
+                else if (option_selected(db, item, et))
+                    et_flags |= TK_LIST_EF_SELECTED;
+            }
+
+            if (et_flags & flags) {
+                switch (token.ttype) {
                 case TT_BOOL:
                     fprintf(fp, "%s ", item->common.symbol);
-                    fprintf(fp, "%s\n", et->token.TK_BOOL ? "true" : "false");
+                    fprintf(fp, "%s\n", token.TK_BOOL ? "true" : "false");
                     break;
 
                 case TT_INTEGER:
                     fprintf(fp, "%s ", item->common.symbol);
-                    fprintf(fp, "%d\n", et->token.TK_INTEGER);
+                    fprintf(fp, "%d\n", token.TK_INTEGER);
                     break;
 
                 case TT_DESCRIPTION:
                     fprintf(fp, "%s ", item->common.symbol);
-                    fprintf(fp, "%s\n", et->token.TK_STRING);
+                    fprintf(fp, "%s\n", token.TK_STRING);
                     break;
 
                 default:
@@ -495,191 +753,320 @@ int __populate_config_file(const char *filename, unsigned long flags)
             }
         }
     }
+}
+
+int __populate_config_file(struct db *db, const char *filename,
+    unsigned long flags)
+{
+    FILE *fp;
+    char *data;
+    size_t size;
+    int ret;
+
+    if ((fp = open_memstream(&data, &size)) == NULL)
+        return -1;
 
+    fprintf_config_file(db, fp, flags);
     fclose(fp);
-    return SUCCESS;
+
+    /* ... file does not exist if dumping defaults. */
+    ret = update_file(filename, data, size, CONFIG_FILE_MODE,
+            (flags & TK_LIST_EF_DEFAULT) != 0);
+    free(data);
+
+    return ret;
 }
 
-static void update_select_token_list(struct token_list *head, bool n)
+/* Index of the first option of a choice with the value in 'n'; 'NO_OPTION'
+ * if there is none. */
+static int find_option(item_t *item, string_t n)
 {
-    item_t *item;
-    struct token_list *tp;
-
-    /* Handle entries in 'selects' list, if any ... */
-    token_list_for_each(tp, head) {
-        struct extended_token *e, *et = item_token_list_entry(tp);
-
-        if ((item = hash_get_item(et->token.TK_STRING)) != NULL) {
-
-            /* ... if entry is of 'TT_BOOL' type, toggle it as needed. */
-            if (((e = item_get_config_et(item)) != NULL) &&
-                (e->token.ttype == TT_BOOL)) {
-
-                if (n == true) {
-
-                    /* If 'TK_LIST_EF_DEFAULT' is set, then we have not
-                     * processed this item in 'read_config_file' yet. We do
-                     * not update the state to 'true' even if it is 'false'.
-                     * 'read_config_file' should handle it.
-                     */
-
-                    if (e->flags & TK_LIST_EF_DEFAULT ||
-                        e->token.TK_BOOL == true)
-                        item_inc(item);
-                    else {
-                        e->token.TK_BOOL = true;
-                        update_select_token_list(item->tk_list->next, true);
-                    }
-                } else {
-                    if (item->refcount > 0)
-                        item_dec(item);
-
-                    else if (e->token.TK_BOOL == true) {
-                        e->token.TK_BOOL = false;
-                        update_select_token_list(item->tk_list->next, false);
-                    }
-                }
-            } else
-                debug_print("Incompatible select: %s.\n", et->token.TK_STRING);
+    struct extended_token *et;
+    unsigned int i;
+    long number = 0;
 
-        } else
-            debug_print("Undefined select: %s.\n", et->token.TK_STRING);
+    /* ... use ''strtol'' as string ''n'' can start with '0x...'; Convert the
+     * value once, not per option. */
+
+    if (item_ttype(item) == TT_INTEGER)
+        number = strtol(n, NULL, 0);
+
+    for (i = 0; i < item->nr_options; i++) {
+        et = item->options[i];
+
+        if (((et->token.ttype == TT_INTEGER) &&
+                (et->token.TK_INTEGER == number)) ||
+            ((et->token.ttype == TT_DESCRIPTION) &&
+                (strcmp(et->token.TK_STRING, n) == 0)))
+            return i;
     }
 
+    return NO_OPTION;
 }
 
-void __toggle_choice(struct extended_token *et, string_t n)
+/* Select the default option of every choice, as reading the output of
+ * '--dump' does; Of many default options, the last one is selected. */
+void default_choices(struct db *db)
 {
-    if (((et->token.ttype == TT_INTEGER) &&
-            /* ... use ''strtol'' as string ''n'' can start with '0x...' */
-            (et->token.TK_INTEGER == strtol(n, NULL, 0))) ||
-        ((et->token.ttype == TT_DESCRIPTION) &&
-            (strcmp(et->token.TK_STRING, n) == 0))) {
+    item_t *item;
+    unsigned int i;
+    int n;
 
-        et->flags |= TK_LIST_EF_SELECTED;
+    LIST_FOREACH(item, &db->tree->symtable, sym_node) {
+        n = NO_OPTION;
+
+        for (i = 0; i < item->nr_options; i++) {
+            if (item->options[i]->flags & TK_LIST_EF_DEFAULT)
+                n = i;
+        }
+
+        if (n != NO_OPTION) {
+            item_set_data(db, item, n);
+            invalidate_item(db, item);
+        }
     }
 }
 
-void toggle_config(item_t *item, ...)
+void toggle_choice(struct db *db, item_t *item, string_t n)
+{
+    item_set_data(db, item, find_option(item, n));
+    invalidate_item(db, item);
+}
+
+void toggle_config(struct db *db, item_t *item, ...)
 {
     va_list va;
-    struct extended_token *et;
+    int ttype = item_ttype(item);
+    int n;
 
     va_start(va, item);
-    et = item_get_config_et(item);
 
     /* Sure 'TK_LIST_EF_CONFIG' is set. */
-    if (et->token.ttype == TT_BOOL) {
-        et->token.TK_BOOL = !et->token.TK_BOOL;
+    if (ttype == TT_BOOL) {
+        /* ... a selected item stays 'true' until nothing selects it. */
+        item_set_own(db, item, !item_bool(db, item));
 
-        update_select_token_list(item->tk_list->next, et->token.TK_BOOL);
+        update_selects(db, item);
 
-    } else if (et->token.ttype == TT_INTEGER)
-        et->token.TK_INTEGER = va_arg(va, int);
+    } else if (ttype == TT_INTEGER)
+        item_set_data(db, item, va_arg(va, int));
 
     else {                      /* and TT_DESCRIPTION. */
-        free(et->token.TK_STRING);
-        et->token.TK_STRING = va_arg(va, string_t);
+        /* The old string stays in 'db->strings' until 'release_db'. */
+        if ((n = intern_string(db, va_arg(va, string_t))) != -1)
+            item_set_data(db, item, n);
     }
 
     va_end(va);
+
+    invalidate_item(db, item);
 }
 
-int read_config_file(const char *filename)
+/* Assign 'str' to 'item' as is; Selects are applied in 'apply_selects'. */
+static void load_value(struct db *db, item_t *item, string_t str)
 {
-    item_t *item;
     struct extended_token *et;
+    bool value;
+    int n;
 
-    FILE *fp;
-    string_t symbol = NULL, value;
-    size_t n = 0;
+    if ((et = item_get_config_et(item)) == NULL) {
+        item_set_data(db, item, find_option(item, str));
+        return;
+    }
 
-    if ((fp = fopen(filename, "r")) == NULL)
+    if (et->token.ttype == TT_BOOL) {
+        value = (strncmp(str, "true", 4) == 0);
+
+        item_set_bool(db, item, value);
+        item_set_own(db, item, value);
+
+    } else if (et->token.ttype == TT_INTEGER)
+        item_set_data(db, item, strtol(str, NULL, 0));
+
+    else if ((n = intern_string(db, str)) != -1)        /* and TT_DESCRIPTION. */
+        item_set_data(db, item, n);
+}
+
+/* Check 'value' is a value of 'item', i.e. 'true' or 'false', an integer,
+ * or one of the options of a choice. */
+static bool valid_value(item_t *item, string_t value)
+{
+    char *end;
+
+    if (item_ttype(item) == TT_BOOL)
+        return (strcmp(value, "true") == 0) || (strcmp(value, "false") == 0);
+
+    if (item_ttype(item) == TT_INTEGER) {
+        strtol(value, &end, 0);
+
+        if ((value[0] == '\0') || (end[0] != '\0'))
+            return false;
+    }
+
+    if (item_get_config_et(item) != NULL)
+        return true;
+
+    return find_option(item, value) != NO_OPTION;
+}
+
+/* The item assigned in 'SYMBOL<sep>value' in 'p', its value is at 'value';
+ * NULL if the line is not an assignment of a symbol, or with 'strict', of a
+ * valid value. 'errno' is 'EINVAL' for a line which is not an assignment,
+ * 'ENOENT' for an undefined symbol and 'ERANGE' for an invalid value. */
+static item_t *load_line(struct db *db, char *p, char sep, bool strict,
+    char **value)
+{
+    item_t *item;
+    char *s;
+
+    if ((s = strchr(p, sep)) == NULL) {
+        if (strict)
+            error_print("Invalid assignment: %s.\n", p);
+        else
+            debug_print("Invalid line: %s.\n", p);
+
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((item = hash_get_item(db,
+                sym_lookup(&db->symtab, p, s - p))) == NULL) {
+        if (strict)
+            error_print("Undefined symbol: %.*s.\n", (int)(s - p), p);
+        else
+            debug_print("Undefined symbol: %.*s.\n", (int)(s - p), p);
+
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if (strict && !valid_value(item, s + 1)) {
+        error_print("Invalid value of %s: %s.\n", item->common.symbol, s + 1);
+        errno = ERANGE;
+        return NULL;
+    }
+
+    *value = s + 1;
+
+    return item;
+}
+
+/* Assign the value of 'SYMBOL<sep>value' in 'p'; Values of '.old.config'
+ * are loaded as they are, invalid lines are skipped. With 'strict', they
+ * are errors. */
+static int assign_line(struct db *db, char *p, char sep, bool strict)
+{
+    item_t *item;
+    char *value;
+
+    if ((item = load_line(db, p, sep, strict, &value)) == NULL)
+        return strict ? -1 : SUCCESS;
+
+    load_value(db, item, value);
+
+    return SUCCESS;
+}
+
+/* The file is mapped and lines are terminated in place, string values point
+ * into the mapping. */
+static int load_file(struct db *db, const char *filename, char sep,
+    bool strict)
+{
+    struct mapping *map;
+    char *p, *end, *eol;
+
+    if ((map = map_file(db, filename)) == NULL)
         return -1;
 
-    while (getline(&symbol, &n, fp) != -1) {
-        if (symbol[0] == '#')
+    for (p = map->addr, end = p + map->file_size; p < end; p = eol + 1) {
+        if ((eol = memchr(p, '\n', end - p)) == NULL)
+            eol = end;          /* ... the mapping is zero-filled after. */
+
+        *eol = '\0';
+
+        if ((p[0] == '#') || (p == eol))
             continue;
 
-        string_t tmp = strstr(symbol, "\n");
+        if (assign_line(db, p, sep, strict) == -1)
+            return -1;
+    }
 
-        if (tmp != NULL)        /* and get ride of delimiter. */
-            tmp[0] = '\0';
+    return SUCCESS;
+}
 
-        tmp = strstr(symbol, " ");
-        tmp[0] = '\0';
-        value = &tmp[1];
+/* Apply selects in a single pass, once values are loaded or set. */
+void apply_config(struct db *db)
+{
+    apply_selects(db);
+    invalidate_db(db);
+}
 
-        if ((item = hash_get_item(symbol)) == NULL) {
-            debug_print("Undefined symbol: %s.\n", symbol);
-            continue;
-        }
+/* Load '.old.config' without applying selects, see 'read_config_file'. */
+int load_config_file(struct db *db, const char *filename)
+{
+    int ret;
 
-        item_token_list_for_each_entry(et, item) {
+    trace_begin("read_config_file", filename);
+    ret = load_file(db, filename, ' ', false);
+    trace_end();
 
-            if (et->flags & TK_LIST_EF_CONFIG) {
-                /* 'TK_LIST_EF_DEFAULT' is always set. */
-
-                if (et->token.ttype == TT_BOOL) {
-                    int tmp = strncmp(value, "true", 4);
-
-                    if (et->token.TK_BOOL == true) {
-
-                        /* Here, 'refcount' represents number of times other
-                         * configuration items selected this item, e.g. 'refcount == 2'
-                         * means this item has been selected 2 times so far.
-                         *
-                         * We only change 'TK_BOOL' to false if 'refcount' is zero.
-                         * As 'TK_LIST_EF_DEFAULT' is set, i.e. it has not been
-                         * processed before in this function, changing to 'false'
-                         * does not case any changes to other configuration items.
-                         */
-
-                        if (tmp != 0) {
-                            if (item->refcount > 0)
-                                item_dec(item);
-                            else
-                                et->token.TK_BOOL = false;
-                        }
-                    } else {
-                        if (tmp != 0) {
-                            if (item->refcount > 0) {
-                                item_dec(item);
-
-                                /* We should leave this item as 'false', Here.
-                                 * But as 'refcount' is already greater than zero,
-                                 * this item has been selected before, so we set
-                                 * it to 'true' instead.
-                                 */
-
-                                et->token.TK_BOOL = true;
-                            }
-                        } else
-                            et->token.TK_BOOL = true;
-                    }
-
-                    if (et->token.TK_BOOL == true)
-                        update_select_token_list(et->node.next, true);
-
-                } else if (et->token.ttype == TT_INTEGER)
-                    et->token.TK_INTEGER = atoi(value);
-
-                else {          /* and TT_DESCRIPTION. */
-                    free(et->token.TK_STRING);
-                    et->token.TK_STRING = strdup(value);
-                }
+    return ret;
+}
 
-                et->flags &= ~TK_LIST_EF_DEFAULT;
-                break;          /* Try next line. */
-            } else
-                __toggle_choice(et, value);
-        }
+/* Load '.old.config' in two phases: Values are assigned as they are in the
+ * file, then selects are applied in a single pass. */
+int read_config_file(struct db *db, const char *filename)
+{
+    if (load_config_file(db, filename) == -1)
+        return -1;
+
+    apply_config(db);
+
+    return SUCCESS;
+}
+
+/* Set a value from 'SYMBOL=value', as '--set'; Selects are applied with
+ * 'apply_config', once all values are set. */
+int set_config(struct db *db, const char *assignment)
+{
+    char *p;
+
+    if ((p = arena_strdup(&db->string_arena, assignment)) == NULL)
+        return -1;
+
+    return assign_line(db, p, '=', true);
+}
+
+/* Set a value from 'SYMBOL=value' on evaluated values, e.g. of a snapshot of
+ * 'serve.c'; It is propagated at once, as 'toggle_config' does, rather than
+ * in a pass over all items. 'errno' is set as in 'load_line' on errors. */
+int update_config(struct db *db, const char *assignment)
+{
+    item_t *item;
+    char *p, *value;
+
+    if ((p = arena_strdup(&db->string_arena, assignment)) == NULL) {
+        errno = ENOMEM;
+        return -1;
     }
 
-    fclose(fp);
+    if ((item = load_line(db, p, '=', true, &value)) == NULL)
+        return -1;
 
-    if (symbol != NULL)
-        free(symbol);
+    if ((item_get_config_et(item) != NULL) && (item_ttype(item) == TT_BOOL)) {
+        /* ... a selected item stays 'true' until nothing selects it. */
+        item_set_own(db, item, strcmp(value, "true") == 0);
+        update_selects(db, item);
+    } else
+        load_value(db, item, value);
+
+    invalidate_item(db, item);
 
     return SUCCESS;
 }
+
+/* Set values from 'SYMBOL=value' lines of 'filename', as '--set-from'. */
+int set_config_file(struct db *db, const char *filename)
+{
+    return load_file(db, filename, '=', true);
+}
@@ -3,7 +3,11 @@
 #ifndef __DB_H__
 #define __DB_H__
 
+#include <time.h>
+
 #include "config.parser.h"
+#include "arena.h"
+#include "values.h"
 #include "queue.h"
 
 #define SUCCESS 0
@@ -24,9 +28,6 @@ struct include {
     LIST_HEAD node;
 };
 
-extern menu_t main_menu, *curr_menu;
-extern LIST_HEAD files;
-
 struct item_shared {
     string_t prompt;            /* entry's prompt string. */
     string_t symbol;            /* entry's configuration symbol. */
@@ -37,7 +38,7 @@ struct item_shared {
 #define TK_LIST_EF_NULL 0
 #define TK_LIST_EF_DEFAULT 1
 #define TK_LIST_EF_CONFIG 2
-#define TK_LIST_EF_SELECTED 4
+#define TK_LIST_EF_SELECTED 4   /* ... in values, see 'option_selected'. */
 #define TK_LIST_EF_CONDITIONAL 8
 
 struct extended_token {
@@ -53,15 +54,13 @@ struct extended_token {
 
 typedef struct item {
     struct item_shared common;
-
-    unsigned long refcount;
-#define item_inc(_i) (_i)->refcount++
-#define item_dec(_i) (_i)->refcount--
+    symbol_t id;                /* ... the value is in 'db->values'. */
 
     /* Token list stores list of extended tokens related to this item.
      *
      * Configuration Option - The first entry in this list has 'TK_LIST_EF_CONFIG'
-     * flag and stores token for 'BOOL', 'INTEGER' or 'STRING' type. The remaining
+     * flag and stores the default token of 'BOOL', 'INTEGER' or 'STRING' type;
+     * The value is kept in 'db->values'. The remaining
      * entries are tokens from 'select' keyword with 'TK_LIST_EF_NULL' flag.
      *
      * Multiple Choices - List of tokens for 'option' keywords. The default entry
@@ -69,6 +68,12 @@ typedef struct item {
 
     struct token_list *tk_list;
 
+    /* Options of a multiple choice, in order; The selected option is kept as
+     * an index, see 'values.h'. */
+
+    struct extended_token **options;
+    unsigned int nr_options;
+
 #define item_token_list_entry(ptr) ({ \
         typeof(ptr) ____ptr  = (ptr); \
         ____ptr ? container_of(____ptr , struct extended_token, node) : NULL; \
@@ -79,53 +84,277 @@ typedef struct item {
         pos != NULL; \
         pos = item_token_list_entry(pos->node.next))
 
+    /* Position in the evaluation order and reverse dependencies, i.e. the
+     * compiled expressions that read this item. */
+
+    unsigned int rank;
+
+    struct bytecode **readers;
+    unsigned int nr_readers;
+
+    /* Items selected by this item and items selecting it. */
+
+    struct item **selects, **selectors;
+    unsigned int nr_selects, nr_selectors;
+
     LIST_HEAD node;
     LIST_HEAD sym_node;
 } item_t;
 
+/* A configuration file mapped to memory; 'TT_DESCRIPTION' tokens point into
+ * the mapping, see 'yy_parse_file'. 'file' is 'NULL' for the mapping of the
+ * binary cache, see 'load_cache'. */
+
+struct mapping {
+    char *addr;
+    size_t size;
+
+    /* ... the file as it was mapped; Key to the binary cache. */
+
+    const char *file;
+    struct timespec mtime;
+    size_t file_size;
+    unsigned long long hash;
+
+    struct mapping *next;
+};
+
+/* The database context; Holds a configuration tree and its state. Every
+ * function accessing the database accepts the context, so multiple databases
+ * can be used at the same time, e.g. on separate threads. */
+
+struct db {
+    menu_t main_menu, *curr_menu;
+    LIST_HEAD files;
+    LIST_HEAD symtable;         /* List of items, in order of definition. */
+
+    /* The database of the lists above; 'db' itself, or the database a view
+     * shares the linked tree of, see 'share_db'. */
+
+    struct db *tree;
+
+    struct symtab symtab;
+
+    /* The database holds a single included file, parsed on its own; It is
+     * merged to its parent with 'merge_fragment', see 'include.c'. */
+
+    bool fragment;
+
+    /* Nodes of the database are allocated from 'node_arena' and strings from
+     * 'string_arena', see 'release_db'. */
+
+    struct arena node_arena, string_arena;
+    struct mapping *mappings;
+
+    /* Compiled expressions and evaluation state, see 'eval.c'. The queue
+     * and cached results are of 'db', the tree is not written by them. */
+
+    struct bytecode *codes;
+    unsigned int nr_codes;
+    item_t **eval_order, **eval_queue;
+    unsigned int nr_items, nr_queued;
+    bool *queued;               /* ... indexed by 'id' of items. */
+    struct result *results;     /* ... indexed by 'id' of expressions. */
+    unsigned long generation, eval_generation;
+
+    /* Items sorted on selects and the worklist, see 'select.c'. */
+
+    item_t **select_order, **select_queue;
+
+    /* Values of the configuration and their strings, see 'values.c'. */
+
+    struct values values;
+    struct symtab strings;
+};
+
+extern void init_db(struct db *);
+extern void release_db(struct db *);
+extern int share_db(struct db *, struct db *);
+
+static inline item_t *hash_get_item(struct db *db, symbol_t symbol)
+{
+    item_t *item = NULL;
+
+    if (symbol < nr_symbols(&db->symtab))
+        item = sym_get(&db->symtab, symbol)->item;
+
+    stat_inc(STAT_ITEM_LOOKUP);
+
+    if (item == NULL)
+        stat_inc(STAT_ITEM_MISS);
+
+    return item;
+}
+
 static inline struct extended_token *item_get_config_et(item_t *item)
 {
     struct extended_token *et = item_token_list_entry(item->tk_list);
     return et->flags & TK_LIST_EF_CONFIG ? et : NULL;
 }
 
-extern int __populate_config_file(const char *, unsigned long);
-#define create_config_file(_f) __populate_config_file((_f), TK_LIST_EF_DEFAULT)
-#define write_config_file(_f)  __populate_config_file((_f), \
-    (TK_LIST_EF_CONFIG | TK_LIST_EF_SELECTED))
+/* Values of 'item', see 'values.h'. */
+
+#define item_page(_db, _i) value_get(&(_db)->values, (_i)->id)
+
+static inline bool item_bool(struct db *db, item_t *item)
+{
+    return value_test(item_page(db, item)->bools, item->id);
+}
+
+static inline bool item_own(struct db *db, item_t *item)
+{
+    return value_test(item_page(db, item)->own, item->id);
+}
+
+static inline bool item_is_visible(struct db *db, item_t *item)
+{
+    return value_test(item_page(db, item)->visible, item->id);
+}
+
+static inline int item_data(struct db *db, item_t *item)
+{
+    return item_page(db, item)->data[value_slot(item->id)];
+}
+
+static inline unsigned int item_refcount(struct db *db, item_t *item)
+{
+    return item_page(db, item)->refcount[value_slot(item->id)];
+}
 
-extern int read_config_file(const char *);
+/* Set a value of 'item'; Pages are written only if the value changes, and
+ * the item is marked changed for 'eval_db'. */
 
-extern int fprintf_menu(FILE *, menu_t *);
-static inline int build_autoconfig(const char *filename)
+static inline void item_set_bool(struct db *db, item_t *item, bool value)
 {
-    FILE *fp;
+    struct value_page *page;
+
+    if (item_bool(db, item) == value)
+        return;
 
-    if ((fp = fopen(filename, "w+")) == NULL)
-        return -1;
+    page = value_write(&db->values, item->id);
+    value_assign(page->bools, item->id, value);
+    value_assign(page->changed, item->id, true);
+}
+
+static inline void item_set_data(struct db *db, item_t *item, int value)
+{
+    struct value_page *page;
 
-    fprintf(fp, "#ifndef __UCONFIG_H\n");
-    fprintf(fp, "#define __UCONFIG_H\n");
-    fprintf_menu(fp, &main_menu);
-    fprintf(fp, "#endif /* __UCONFIG_H */\n");
-    fclose(fp);
+    if (item_data(db, item) == value)
+        return;
 
-    return SUCCESS;
+    page = value_write(&db->values, item->id);
+    page->data[value_slot(item->id)] = value;
+    value_assign(page->changed, item->id, true);
 }
 
-extern void __toggle_choice(struct extended_token *, string_t);
-static inline void toggle_choice(item_t *item, string_t n)
+static inline void item_set_own(struct db *db, item_t *item, bool value)
 {
-    struct extended_token *et;
+    if (item_own(db, item) != value)
+        value_assign(value_write(&db->values, item->id)->own, item->id, value);
+}
 
-    item_token_list_for_each_entry(et, item) {
-        /* Remove 'TK_LIST_EF_SELECTED', first. */
-        et->flags &= ~TK_LIST_EF_SELECTED;
-        __toggle_choice(et, n);
-    }
+static inline void item_set_refcount(struct db *db, item_t *item,
+    unsigned int value)
+{
+    if (item_refcount(db, item) != value)
+        value_write(&db->values, item->id)->refcount[value_slot(item->id)] =
+            value;
 }
 
-extern void toggle_config(item_t *, ...);
-extern bool eval_expr(expr_t);
+/* Type of values an item can take; Configuration option stores it at the head
+ * of the token list and multiple choices in all of the options. */
+
+#define item_ttype(i) ({ \
+        struct extended_token *____et = item_token_list_entry((i)->tk_list); \
+        ____et ? ____et->token.ttype : TT_INVALID; \
+    })
+
+extern char *map_config_file(struct db *, const char *, size_t *);
+extern void unmap_files(struct db *, struct mapping *);
+extern int yy_parse_file(struct db *, const char *);
+
+extern int merge_fragment(struct db *, struct db *, menu_t *);
+extern int parse_includes(struct db *, int);
+
+/* Modes of '.old.config' and the autoconfig header. */
+#define CONFIG_FILE_MODE (S_IRUSR | S_IWUSR)
+#define AUTOCONFIG_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | \
+        S_IWOTH)
+
+extern void fprintf_config_file(struct db *, FILE *, unsigned long);
+extern int __populate_config_file(struct db *, const char *, unsigned long);
+#define create_config_file(_db, _f) \
+    __populate_config_file((_db), (_f), TK_LIST_EF_DEFAULT)
+#define write_config_file(_db, _f) \
+    __populate_config_file((_db), (_f), \
+        (TK_LIST_EF_CONFIG | TK_LIST_EF_SELECTED))
+
+extern int load_config_file(struct db *, const char *);
+extern int read_config_file(struct db *, const char *);
+extern int set_config(struct db *, const char *);
+extern int update_config(struct db *, const char *);
+extern int set_config_file(struct db *, const char *);
+extern void apply_config(struct db *);
+
+extern int fprintf_menu(struct db *, FILE *, menu_t *);
+extern void fprintf_autoconfig(struct db *, FILE *);
+extern int build_autoconfig(struct db *, const char *);
+extern int update_file(const char *, const char *, size_t, mode_t, bool);
+
+/* Per-symbol stamps for 'fixdep', see 'stamps.c'. */
+extern int update_stamps(struct db *, const char *);
+
+extern void invalidate_db(struct db *);
+extern void invalidate_item(struct db *, item_t *);
+extern void invalidate_expr(struct db *, expr_t);
+
+/* Propagate selects, see 'select.c'. */
+extern int link_selects(struct db *);
+extern unsigned int update_selects(struct db *, item_t *);
+extern void apply_selects(struct db *);
+
+extern void default_choices(struct db *);
+extern void toggle_choice(struct db *, item_t *, string_t);
+extern void toggle_config(struct db *, item_t *, ...);
+
+/* Values as tokens and snapshots of values, see 'values.c'. */
+extern token_t item_get_token(struct db *, item_t *);
+extern bool option_selected(struct db *, item_t *, struct extended_token *);
+extern int link_options(struct db *);
+extern int intern_string(struct db *, const char *);
+
+extern int init_values(struct db *);
+extern int snapshot_values(struct db *, struct values *);
+extern void restore_values(struct db *, const struct values *);
+
+/* Binary cache of the linked database, see 'cache.c'. */
+
+struct image;
+struct bytecode;
+
+extern void image_object(struct image *, const void *, size_t);
+extern void image_pointer(struct image *, void *);
+extern void image_string(struct image *, char **);
+extern void image_token(struct image *, token_t *);
+extern void image_codes(struct image *, struct db *);
+
+extern unsigned long long cache_hash(const void *, size_t);
+extern int load_cache(struct db *, const char *, const char *);
+extern int save_cache(struct db *, const char *, const char *);
+
+/* Compile expressions, see 'eval.c'. */
+extern int link_db(struct db *);
+extern int init_eval(struct db *);
+
+extern void rank_push(item_t **, unsigned int *, item_t *);
+extern item_t *rank_pop(item_t **, unsigned int *);
+extern item_t *reader_item(item_t *, unsigned int);
+
+extern void eval_db(struct db *);
+extern void reset_eval(struct db *);
+extern int eval_string(struct db *, char *, bool *);
+extern bool eval_item(struct db *, item_t *);
+extern bool eval_expr(struct db *, expr_t);
 
 #endif /* __DB_H__ */
@@ -15,6 +15,7 @@
 
 #define _IN_FILE "configs.in"
 #define _OUT_FILE "sys.config.h"
+#define _CACHE_FILE ".configs.cache"
 
 #ifdef DEBUG
 #define debug_print(...) \
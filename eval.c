@@ -0,0 +1,1181 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <ctype.h>
+
+#include "db.h"
+#include "defaults.h"
+#include "y.tab.h"
+
+/* Expressions are compiled, once after parsing, to a flat program for an
+ * accumulator machine. Symbols are resolved to their items and operand types
+ * are checked at compile time, so 'eval_expr' never looks up a symbol.
+ *
+ * 'A && B' is compiled to 'A; BC_JFALSE end; B; end:' and 'A || B' to
+ * 'A; BC_JTRUE end; B; end:', i.e. the accumulator holds the result of the
+ * evaluated operand when jumping.
+ *
+ * Items are sorted topologically on their dependencies, so visibility of all
+ * items is computed in a single pass over 'eval_order'. Results are kept with
+ * the values as bits, see 'values.h', and compiled programs read them.
+ *
+ * Each item keeps the list of compiled expressions that read it, i.e. the
+ * reverse dependencies. Changing an item queues it for evaluation; if its
+ * visibility or value changes, expressions reading it are invalidated and
+ * items depending on them are queued as well. Queued items are processed
+ * in 'eval_order', so an item is evaluated once after all its dependencies.
+ *
+ * Operands of a chain of 'AND', or of 'OR', that are 'BOOL' symbols or 'NOT'
+ * of one, are merged by the 64-bit word their bits are in: 'A && NOT B && C'
+ * is a single 'BC_ALL' if the three are in the same word, so an expression of
+ * 'BOOL' symbols only is a few word operations on the packed values, see
+ * 'value_word'. Comparisons with '==' and '!=' are evaluated one by one.
+ */
+
+enum bc_op {
+    BC_CONST,                   /* acc = 'value'. */
+    BC_BOOL,                    /* acc = 'item' is a visible 'true'. */
+    BC_EQUAL,                   /* acc = 'item' == 'token'. */
+    BC_NEQUAL,                  /* acc = 'item' != 'token'. */
+    BC_EQUAL_ITEM,              /* acc = 'item' == 'item2'. */
+    BC_NEQUAL_ITEM,             /* acc = 'item' != 'item2'. */
+    BC_ALL,                     /* acc = bits of 'mask' in 'word' are set. */
+    BC_ANY,                     /* acc = a bit of 'mask' in 'word' is set. */
+    BC_NOT,                     /* acc = !acc. */
+    BC_JFALSE,                  /* if (!acc) goto 'target'. */
+    BC_JTRUE                    /* if (acc) goto 'target'. */
+};
+
+/* Bits of 'BC_ALL' and 'BC_ANY' are of the word 'word' of visible 'true'
+ * values, with the bits of 'neg' inverted, i.e. for 'NOT' operands. */
+
+struct insn {
+    enum bc_op op;
+    union {
+        bool value;
+        unsigned int target;
+        unsigned int word;
+        item_t *item;
+    };
+
+    union {
+        token_t token;
+        item_t *item2;
+
+        struct {
+            uint64_t mask, neg;
+        };
+    };
+};
+
+struct bytecode {
+    item_t *item;               /* Item depends on this expression, if any. */
+    unsigned int id;            /* ... index in 'db->results'. */
+
+    struct bytecode *next;      /* ... in 'codes' list. */
+
+    unsigned int len;
+    struct insn insn[];
+};
+
+/* Cached result of an expression of 'db'; It is valid if 'generation' is the
+ * database generation. */
+
+struct result {
+    unsigned long generation;
+    bool value;
+};
+
+/* 'db->generation' is bumped to invalidate all the cached results at once.
+ * All items are evaluated if 'db->eval_generation' is not the same. */
+
+void invalidate_db(struct db *db)
+{
+    db->generation++;
+}
+
+/* Binary heaps of items ordered by 'rank', e.g. 'eval_queue'; 'heap' has
+ * room for all items. */
+
+void rank_push(item_t **heap, unsigned int *n, item_t *item)
+{
+    unsigned int i, parent;
+
+    for (i = (*n)++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+
+        if (heap[parent]->rank <= item->rank)
+            break;
+
+        heap[i] = heap[parent];
+    }
+
+    heap[i] = item;
+}
+
+item_t *rank_pop(item_t **heap, unsigned int *n)
+{
+    item_t *item = heap[0], *last = heap[--(*n)];
+    unsigned int i = 0, child;
+
+    while ((child = 2 * i + 1) < *n) {
+        if ((child + 1 < *n) && (heap[child + 1]->rank < heap[child]->rank))
+            child++;
+
+        if (last->rank <= heap[child]->rank)
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = last;
+
+    return item;
+}
+
+static void queue_item(struct db *db, item_t *item)
+{
+    if (db->queued[item->id])
+        return;
+
+    db->queued[item->id] = true;
+    rank_push(db->eval_queue, &db->nr_queued, item);
+}
+
+static item_t *dequeue_item(struct db *db)
+{
+    item_t *item = rank_pop(db->eval_queue, &db->nr_queued);
+
+    db->queued[item->id] = false;
+
+    return item;
+}
+
+void invalidate_item(struct db *db, item_t *item)
+{
+    /* ... before 'link_db', nothing is cached. */
+    if (db->eval_queue != NULL)
+        queue_item(db, item);
+}
+
+/* Drop the cached result of 'expr' only, e.g. to time its evaluation. */
+void invalidate_expr(struct db *db, expr_t expr)
+{
+    if (expr != NULL)
+        db->results[expr->code->id].generation = db->generation - 1;
+}
+
+static bool __eval_expr(token_t token1, token_t token2, enum expr_op op)
+{
+    switch (token1.ttype) {
+    case TT_BOOL:
+        if (op == OP_EQUAL)
+            return (token1.TK_BOOL == token2.TK_BOOL);
+
+        if (op == OP_NEQUAL)
+            return (token1.TK_BOOL != token2.TK_BOOL);
+
+        break;
+
+    case TT_INTEGER:
+        if (op == OP_EQUAL)
+            return (token1.TK_INTEGER == token2.TK_INTEGER);
+
+        if (op == OP_NEQUAL)
+            return (token1.TK_INTEGER != token2.TK_INTEGER);
+
+        break;
+
+    case TT_DESCRIPTION:
+        if (op == OP_EQUAL)
+            return (strcmp(token1.TK_STRING, token2.TK_STRING) == 0);
+
+        if (op == OP_NEQUAL)
+            return (strcmp(token1.TK_STRING, token2.TK_STRING) != 0);
+
+        break;
+
+    default:
+        debug_print("Unable to compute 'expr'.\n");
+    }
+
+    return false;
+}
+
+/* Get the token of a visible 'item'. */
+static inline bool visible_token(struct db *db, item_t *item, token_t *token)
+{
+    if (!item_is_visible(db, item))
+        return false;
+
+    *token = item_get_token(db, item);
+    return token->ttype != TT_INVALID;
+}
+
+static bool run_bytecode(struct db *db, const struct bytecode *code)
+{
+    const struct insn *insn;
+    const struct value_page *page;
+    token_t token, token2;
+    unsigned int pc = 0;
+    bool acc = false;
+
+    while (pc < code->len) {
+        insn = &code->insn[pc++];
+
+        switch (insn->op) {
+        case BC_CONST:
+            acc = insn->value;
+            break;
+
+        case BC_BOOL:
+            page = item_page(db, insn->item);
+            acc = value_test(page->visible, insn->item->id) &&
+                value_test(page->bools, insn->item->id);
+            break;
+
+        case BC_EQUAL:
+            acc = visible_token(db, insn->item, &token) &&
+                __eval_expr(token, insn->token, OP_EQUAL);
+            break;
+
+        case BC_NEQUAL:
+            acc = visible_token(db, insn->item, &token) &&
+                __eval_expr(token, insn->token, OP_NEQUAL);
+            break;
+
+        case BC_EQUAL_ITEM:
+            acc = visible_token(db, insn->item, &token) &&
+                visible_token(db, insn->item2, &token2) &&
+                __eval_expr(token, token2, OP_EQUAL);
+            break;
+
+        case BC_NEQUAL_ITEM:
+            acc = visible_token(db, insn->item, &token) &&
+                visible_token(db, insn->item2, &token2) &&
+                __eval_expr(token, token2, OP_NEQUAL);
+            break;
+
+        case BC_ALL:
+            acc = (((value_word(&db->values, insn->word) ^ insn->neg) &
+                    insn->mask) == insn->mask);
+            break;
+
+        case BC_ANY:
+            acc = (((value_word(&db->values, insn->word) ^ insn->neg) &
+                    insn->mask) != 0);
+            break;
+
+        case BC_NOT:
+            acc = !acc;
+            break;
+
+        case BC_JFALSE:
+            if (!acc)
+                pc = insn->target;
+
+            break;
+
+        case BC_JTRUE:
+            if (acc)
+                pc = insn->target;
+
+            break;
+        }
+    }
+
+    return acc;
+}
+
+/* Operands of an instruction as bits: Bits of 'mask' for word instructions,
+ * otherwise bit 0 is 'item' and bit 1 is 'item2'. */
+static uint64_t insn_operands(const struct insn *insn)
+{
+    switch (insn->op) {
+    case BC_BOOL:
+    case BC_EQUAL:
+    case BC_NEQUAL:
+        return 1;
+
+    case BC_EQUAL_ITEM:
+    case BC_NEQUAL_ITEM:
+        return 3;
+
+    case BC_ALL:
+    case BC_ANY:
+        return insn->mask;
+
+    default:
+        return 0;
+    }
+}
+
+static item_t *insn_item(struct db *db, const struct insn *insn,
+    unsigned int n)
+{
+    switch (insn->op) {
+    case BC_ALL:
+    case BC_ANY:
+        return sym_get(&db->symtab, 64 * insn->word + n)->item;
+
+    case BC_EQUAL_ITEM:
+    case BC_NEQUAL_ITEM:
+        return (n == 0) ? insn->item : insn->item2;
+
+    default:
+        return insn->item;
+    }
+}
+
+/* Items read by 'code', one by one; '*n' is the next operand, i.e. 64 times
+ * the instruction plus the operand bit, 0 to start. NULL at the end. */
+static item_t *code_item(struct db *db, const struct bytecode *code,
+    unsigned int *n)
+{
+    unsigned int pc, bit;
+    uint64_t operands;
+
+    for (; *n < 64 * code->len; *n = (*n | 63) + 1) {
+        pc = *n / 64;
+
+        if ((operands = insn_operands(&code->insn[pc]) >> (*n % 64)) == 0)
+            continue;
+
+        bit = *n % 64 + __builtin_ctzll(operands);
+        *n = 64 * pc + bit + 1;
+
+        return insn_item(db, &code->insn[pc], bit);
+    }
+
+    return NULL;
+}
+
+static unsigned int bytecode_len(expr_t expr)
+{
+    switch (expr->op) {
+    case OP_NOT:
+        return 1 + bytecode_len(expr->NODE.expr);
+
+    case OP_AND:
+    case OP_OR:
+        return 1 + bytecode_len(expr->LEFT.expr) +
+            bytecode_len(expr->RIGHT.expr);
+
+    default:
+        return 1;
+    }
+}
+
+/* Resolve an operand: 'item' is set for a symbol, otherwise it is constant. */
+static int link_operand(struct db *db, token_t token, item_t **item)
+{
+    *item = NULL;
+
+    if (token.ttype != TT_SYMBOL)
+        return token.ttype;
+
+    if ((*item = hash_get_item(db, token.TK_SYMBOL)) == NULL) {
+        debug_print("Broken dependency: %s.\n",
+            sym_name(&db->symtab, token.TK_SYMBOL));
+        return TT_INVALID;
+    }
+
+    return item_ttype(*item);
+}
+
+static void link_leaf(struct db *db, struct insn *insn, expr_t expr)
+{
+    item_t *item1, *item2;
+    int ttype1, ttype2;
+
+    if (expr->op == OP_NULL) {
+        if ((link_operand(db, expr->NODE.token, &item1) != TT_BOOL) ||
+            (item1 == NULL)) {
+            debug_print("Non-boolean dependency.\n");
+
+            insn->op = BC_CONST;
+            insn->value = false;
+        } else {
+            insn->op = BC_BOOL;
+            insn->item = item1;
+        }
+
+        return;
+    }
+
+    /* ... and 'OP_EQUAL' or 'OP_NEQUAL'. */
+
+    ttype1 = link_operand(db, expr->LEFT.token, &item1);
+    ttype2 = link_operand(db, expr->RIGHT.token, &item2);
+
+    if ((ttype1 == TT_INVALID) || (ttype1 != ttype2)) {
+        debug_print("Tokens are incompatible.\n");
+
+        insn->op = BC_CONST;
+        insn->value = false;
+
+    } else if ((item1 != NULL) && (item2 != NULL)) {
+        insn->op = (expr->op == OP_EQUAL) ? BC_EQUAL_ITEM : BC_NEQUAL_ITEM;
+        insn->item = item1;
+        insn->item2 = item2;
+
+    } else if (item1 != NULL) {
+        insn->op = (expr->op == OP_EQUAL) ? BC_EQUAL : BC_NEQUAL;
+        insn->item = item1;
+        insn->token = expr->RIGHT.token;
+
+    } else if (item2 != NULL) {
+        /* Comparisons are symmetric, keep the symbol on left. */
+        insn->op = (expr->op == OP_EQUAL) ? BC_EQUAL : BC_NEQUAL;
+        insn->item = item2;
+        insn->token = expr->LEFT.token;
+
+    } else {
+        insn->op = BC_CONST;
+        insn->value = __eval_expr(expr->LEFT.token, expr->RIGHT.token,
+                expr->op);
+    }
+}
+
+/* 'expr' is a 'BOOL' symbol or 'NOT' of one; Returns its item. */
+static item_t *link_literal(struct db *db, expr_t expr, bool *neg)
+{
+    item_t *item;
+
+    if ((*neg = (expr->op == OP_NOT)))
+        expr = expr->NODE.expr;
+
+    if ((expr->op != OP_NULL) || (expr->NODE.token.ttype != TT_SYMBOL) ||
+        ((item = hash_get_item(db, expr->NODE.token.TK_SYMBOL)) == NULL) ||
+        (item_ttype(item) != TT_BOOL))
+        return NULL;
+
+    return item;
+}
+
+/* A chain of 'AND', or 'OR', is linked as its operands each followed by a
+ * jump to the end. Jumps are linked in a list on 'target' until the end is
+ * known; 'chain' is the last one. */
+
+static unsigned int link_jump(struct bytecode *code, unsigned int pc,
+    enum expr_op op, unsigned int *chain)
+{
+    code->insn[pc].op = (op == OP_AND) ? BC_JFALSE : BC_JTRUE;
+    code->insn[pc].target = *chain;
+    *chain = pc;
+
+    return pc + 1;
+}
+
+/* Literals of the chain 'expr' are merged to a word instruction per word, at
+ * 'start', before other operands; Each is followed by its jump. */
+static unsigned int link_words(struct db *db, struct bytecode *code,
+    unsigned int start, unsigned int pc, expr_t expr, enum expr_op op,
+    unsigned int *chain)
+{
+    struct insn *insn;
+    item_t *item;
+    bool neg;
+
+    if (expr->op == op) {
+        pc = link_words(db, code, start, pc, expr->LEFT.expr, op, chain);
+        return link_words(db, code, start, pc, expr->RIGHT.expr, op, chain);
+    }
+
+    if ((item = link_literal(db, expr, &neg)) == NULL)
+        return pc;
+
+    for (insn = &code->insn[start]; insn < &code->insn[pc]; insn += 2) {
+        if (insn->word == item->id / 64)
+            break;
+    }
+
+    if (insn == &code->insn[pc]) {
+        insn->op = (op == OP_AND) ? BC_ALL : BC_ANY;
+        insn->word = item->id / 64;
+        insn->mask = insn->neg = 0;
+        pc = link_jump(code, pc + 1, op, chain);
+
+    } else if ((insn->mask & value_mask(item->id)) != 0)
+        return pc;              /* ... e.g. 'A && NOT A', see 'link_others'. */
+
+    insn->mask |= value_mask(item->id);
+
+    if (neg)
+        insn->neg |= value_mask(item->id);
+
+    return pc;
+}
+
+static unsigned int link_insn(struct db *db, struct bytecode *code,
+    unsigned int pc, expr_t expr);
+
+/* Operands of the chain 'expr' that are not merged to the word instructions
+ * in 'code->insn[start, end)'. */
+static unsigned int link_others(struct db *db, struct bytecode *code,
+    unsigned int start, unsigned int end, unsigned int pc, expr_t expr,
+    enum expr_op op, unsigned int *chain)
+{
+    unsigned int i;
+    item_t *item;
+    bool neg;
+
+    if (expr->op == op) {
+        pc = link_others(db, code, start, end, pc, expr->LEFT.expr, op,
+                chain);
+        return link_others(db, code, start, end, pc, expr->RIGHT.expr, op,
+                chain);
+    }
+
+    if ((item = link_literal(db, expr, &neg)) != NULL) {
+        for (i = start; i < end; i += 2) {
+            if ((code->insn[i].word == item->id / 64) &&
+                ((code->insn[i].mask & value_mask(item->id)) != 0) &&
+                (((code->insn[i].neg & value_mask(item->id)) != 0) == neg))
+                return pc;
+        }
+    }
+
+    pc = link_insn(db, code, pc, expr);
+
+    return link_jump(code, pc, op, chain);
+}
+
+static unsigned int link_insn(struct db *db, struct bytecode *code,
+    unsigned int pc, expr_t expr)
+{
+    unsigned int start = pc, end, chain = ~0U, jmp;
+
+    switch (expr->op) {
+    case OP_NOT:
+        pc = link_insn(db, code, pc, expr->NODE.expr);
+        code->insn[pc++].op = BC_NOT;
+        break;
+
+    case OP_AND:
+    case OP_OR:
+        end = link_words(db, code, start, pc, expr, expr->op, &chain);
+        pc = link_others(db, code, start, end, end, expr, expr->op, &chain);
+
+        /* ... the last operand is not followed by a jump. */
+        chain = code->insn[--pc].target;
+
+        for (jmp = chain; jmp != ~0U; jmp = chain) {
+            chain = code->insn[jmp].target;
+            code->insn[jmp].target = pc;
+        }
+
+        break;
+
+    default:
+        link_leaf(db, &code->insn[pc++], expr);
+    }
+
+    return pc;
+}
+
+static int link_expr(struct db *db, expr_t expr, item_t *item)
+{
+    struct bytecode *code, *tmp;
+    unsigned int len;
+
+    if ((expr == NULL) || (expr->code != NULL))
+        return SUCCESS;
+
+    /* ... merged operands make it shorter, it is linked to 'tmp' first; The
+     * jump after the last operand of a chain is dropped once linked. */
+    if ((tmp = malloc(sizeof(*tmp) +
+                (bytecode_len(expr) + 1) * sizeof(struct insn))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
+
+    len = link_insn(db, tmp, 0, expr);
+
+    if ((code = arena_alloc(&db->node_arena,
+                sizeof(*code) + len * sizeof(struct insn))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        free(tmp);
+        return -1;
+    }
+
+    memcpy(code->insn, tmp->insn, len * sizeof(struct insn));
+    free(tmp);
+
+    code->item = item;
+    code->id = db->nr_codes++;
+    code->len = len;
+
+    code->next = db->codes;
+    db->codes = code;
+
+    expr->code = code;
+
+    return SUCCESS;
+}
+
+static int link_menu(struct db *db, menu_t *menu)
+{
+    menu_t *m;
+    item_t *item;
+    struct extended_token *et;
+
+    if (link_expr(db, menu->dependency, NULL) == -1)
+        return -1;
+
+    LIST_FOREACH(m, &menu->childs, sibling) {
+        if (link_menu(db, m) == -1)
+            return -1;
+    }
+
+    LIST_FOREACH(item, &menu->entries, node) {
+        if (link_expr(db, item->common.dependency, item) == -1)
+            return -1;
+
+        item_token_list_for_each_entry(et, item) {
+            if (link_expr(db, et->condition, NULL) == -1)
+                return -1;
+        }
+    }
+
+    return SUCCESS;
+}
+
+/* Add 'code' to the reverse dependencies of the items it reads. 'readers' is
+ * NULL when counting. */
+
+static void __link_readers(struct db *db, struct bytecode *code)
+{
+    item_t *item;
+    unsigned int n = 0;
+
+    while ((item = code_item(db, code, &n)) != NULL) {
+        /* ... an expression may read an item more than once. */
+        if ((item->nr_readers > 0) && (item->readers != NULL) &&
+            (item->readers[item->nr_readers - 1] == code))
+            continue;
+
+        if (item->readers != NULL)
+            item->readers[item->nr_readers] = code;
+
+        item->nr_readers++;
+    }
+}
+
+static int link_readers(struct db *db)
+{
+    item_t *item;
+    struct bytecode *code, **readers;
+    unsigned int n = 0;
+
+    /* First pass counts the readers with 'readers' set to NULL. */
+    for (code = db->codes; code != NULL; code = code->next)
+        __link_readers(db, code);
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        n += item->nr_readers;
+    }
+
+    if ((readers = arena_alloc(&db->node_arena,
+                n * sizeof(struct bytecode *))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        item->readers = readers;
+        readers += item->nr_readers;
+        item->nr_readers = 0;
+    }
+
+    for (code = db->codes; code != NULL; code = code->next)
+        __link_readers(db, code);
+
+    return SUCCESS;
+}
+
+#define MARK_NULL 0
+#define MARK_VISITING 1
+#define MARK_DONE 2
+
+struct sort_frame {
+    item_t *item;
+    unsigned int n;             /* Next operand to visit. */
+};
+
+static void print_cycle(struct sort_frame *stack, unsigned int sp,
+    item_t *item)
+{
+    unsigned int i = sp;
+
+    while (stack[--i].item != item) ;
+
+    for (; i < sp; i++)
+        fprintf(stderr, " %s ->", stack[i].item->common.symbol);
+
+    fprintf(stderr, " %s.\n", item->common.symbol);
+}
+
+/* Depth-first topological sort of items on their dependencies. Items are
+ * added to 'eval_order' after all items they depend on. */
+
+static int sort_items(struct db *db)
+{
+    item_t *root, *item, **eval_order;
+    struct sort_frame *stack = NULL, *f;
+    unsigned char *marks = NULL;    /* ... indexed by 'id' of items. */
+    unsigned int sp, nr_items = 0;
+    int ret = -1;
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        nr_items++;
+    }
+
+    if (((eval_order = arena_alloc(&db->node_arena,
+                    nr_items * sizeof(item_t *))) == NULL) ||
+        ((stack = malloc(nr_items * sizeof(struct sort_frame))) == NULL) ||
+        ((marks = calloc(nr_symbols(&db->symtab) + 1, 1)) == NULL)) {
+        error_print("''alloc'' failed.\n");
+        goto out;
+    }
+
+    db->eval_order = eval_order;
+    db->nr_items = nr_items = 0;
+
+    LIST_FOREACH(root, &db->symtable, sym_node) {
+        if (marks[root->id] != MARK_NULL)
+            continue;
+
+        marks[root->id] = MARK_VISITING;
+        stack[0].item = root;
+        stack[0].n = 0;
+        sp = 1;
+
+        while (sp > 0) {
+            expr_t expr = (f = &stack[sp - 1])->item->common.dependency;
+
+            if ((expr != NULL) &&
+                ((item = code_item(db, expr->code, &f->n)) != NULL)) {
+                if (marks[item->id] == MARK_DONE)
+                    continue;
+
+                if (marks[item->id] == MARK_VISITING) {
+                    error_print("Dependency cycle:");
+                    print_cycle(stack, sp, item);
+                    goto out;
+                }
+
+                marks[item->id] = MARK_VISITING;
+                stack[sp].item = item;
+                stack[sp++].n = 0;
+
+            } else {
+                marks[f->item->id] = MARK_DONE;
+                eval_order[db->nr_items++] = f->item;
+                sp--;
+            }
+        }
+    }
+
+    ret = SUCCESS;
+
+out:
+    free(stack);
+    free(marks);
+
+    return ret;
+}
+
+/* Evaluation state of 'db': The queue, cached results of expressions and the
+ * worklist of selects. The linked tree is only read when evaluating, so the
+ * state is all a database needs of its own. */
+
+int init_eval(struct db *db)
+{
+    unsigned int n = nr_symbols(&db->symtab);
+
+    if (((db->eval_queue = arena_alloc(&db->node_arena,
+                    db->nr_items * sizeof(item_t *))) == NULL) ||
+        ((db->queued = arena_alloc(&db->node_arena, n * sizeof(bool))) ==
+            NULL) ||
+        ((db->results = arena_alloc(&db->node_arena,
+                    db->nr_codes * sizeof(struct result))) == NULL) ||
+        ((db->select_queue = arena_alloc(&db->node_arena,
+                    db->nr_items * sizeof(item_t *))) == NULL)) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
+
+    memset(db->queued, 0, n * sizeof(bool));
+    memset(db->results, 0, db->nr_codes * sizeof(struct result));
+    db->nr_queued = 0;
+
+    invalidate_db(db);
+
+    return SUCCESS;
+}
+
+int link_db(struct db *db)
+{
+    unsigned int i;
+
+    if ((link_menu(db, &db->main_menu) == -1) || (link_readers(db) == -1) ||
+        (sort_items(db) == -1))
+        return -1;
+
+    for (i = 0; i < db->nr_items; i++)
+        db->eval_order[i]->rank = i;
+
+    if ((link_selects(db) == -1) || (link_options(db) == -1) ||
+        (init_eval(db) == -1) || (init_values(db) == -1))
+        return -1;
+
+    return SUCCESS;
+}
+
+static void image_insn(struct image *image, struct insn *insn)
+{
+    switch (insn->op) {
+    case BC_BOOL:
+        image_pointer(image, &insn->item);
+        break;
+
+    case BC_EQUAL:
+    case BC_NEQUAL:
+        image_pointer(image, &insn->item);
+        image_token(image, &insn->token);
+        break;
+
+    case BC_EQUAL_ITEM:
+    case BC_NEQUAL_ITEM:
+        image_pointer(image, &insn->item);
+        image_pointer(image, &insn->item2);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Add compiled expressions to the binary cache, see 'cache.c'. */
+void image_codes(struct image *image, struct db *db)
+{
+    struct bytecode *code;
+    unsigned int pc;
+
+    image_pointer(image, &db->codes);
+
+    for (code = db->codes; code != NULL; code = code->next) {
+        image_object(image, code,
+            sizeof(*code) + code->len * sizeof(struct insn));
+        image_pointer(image, &code->item);
+        image_pointer(image, &code->next);
+
+        for (pc = 0; pc < code->len; pc++)
+            image_insn(image, &code->insn[pc]);
+    }
+}
+
+/* Evaluate 'item', return 'true' if its visibility or value has changed. */
+static bool __eval_item(struct db *db, item_t *item)
+{
+    const struct value_page *page = item_page(db, item);
+    struct value_page *p;
+    bool visible, changed;
+
+    stat_inc(STAT_EVAL_ITEM);
+
+    /* Dependencies of 'item' are evaluated, already. */
+    visible = (item->common.dependency == NULL) ||
+        run_bytecode(db, item->common.dependency->code);
+
+    /* ... the value of a hidden item is not seen by readers. */
+    changed = value_test(page->changed, item->id);
+
+    if ((visible == value_test(page->visible, item->id)) && !changed)
+        return false;
+
+    /* ... a shared page is copied only if a result changes. */
+    p = value_write(&db->values, item->id);
+    value_assign(p->changed, item->id, false);
+
+    if (visible == value_test(p->visible, item->id))
+        return visible;
+
+    value_assign(p->visible, item->id, visible);
+
+    return true;
+}
+
+static void eval_update(struct db *db)
+{
+    unsigned int i;
+    item_t *item;
+
+    if (db->eval_generation != db->generation) {
+        /* Evaluate every thing, cached results are invalid already. */
+        while (db->nr_queued > 0)
+            dequeue_item(db);
+
+        for (i = 0; i < db->nr_items; i++)
+            __eval_item(db, db->eval_order[i]);
+
+        db->eval_generation = db->generation;
+    }
+
+    while (db->nr_queued > 0) {
+        if (!__eval_item(db, item = dequeue_item(db)))
+            continue;
+
+        for (i = 0; i < item->nr_readers; i++) {
+            struct bytecode *code = item->readers[i];
+
+            db->results[code->id].generation = 0;
+
+            if (code->item != NULL)
+                queue_item(db, code->item);
+        }
+    }
+}
+
+/* Item depending on the reader 'n' of 'item'; NULL if it is not an item
+ * dependency, e.g. of a menu or of an option. */
+item_t *reader_item(item_t *item, unsigned int n)
+{
+    return item->readers[n]->item;
+}
+
+/* Evaluate items changed since the last evaluation. */
+void eval_db(struct db *db)
+{
+    eval_update(db);
+}
+
+/* Values are replaced with evaluated values, see 'restore_values'; Drop the
+ * queue and the cached results of expressions. */
+void reset_eval(struct db *db)
+{
+    while (db->nr_queued > 0)
+        dequeue_item(db);
+
+    db->eval_generation = ++db->generation;
+}
+
+bool eval_item(struct db *db, item_t *item)
+{
+    eval_update(db);
+
+    return item_is_visible(db, item);
+}
+
+bool eval_expr(struct db *db, expr_t expr)
+{
+    struct result *result;
+
+    stat_inc(STAT_EVAL_EXPR);
+
+    /* No 'depends' keyword, always success. */
+    if (expr == NULL)
+        return true;
+
+    eval_update(db);
+
+    if ((result = &db->results[expr->code->id])->generation !=
+        db->generation) {
+        result->value = run_bytecode(db, expr->code);
+        result->generation = db->generation;
+    }
+
+    return result->value;
+}
+
+/* Expressions of requests, see 'serve.c', are evaluated on the evaluated
+ * state of 'db' as compiled expressions are, but nothing is written to 'db';
+ * It can be shared by threads. 'AND' and 'OR' have the same precedence and
+ * are left associative, as in the parser. */
+
+struct scan {
+    struct db *db;
+    char *p;
+    bool failed;
+};
+
+struct operand {
+    bool symbol;
+    int ttype;
+    item_t *item;               /* ... if 'symbol' is defined. */
+    token_t token;
+};
+
+static inline bool is_ident(char c)
+{
+    return isalnum((unsigned char)c) || (c == '_');
+}
+
+static bool accept(struct scan *s, const char *str)
+{
+    size_t len = strlen(str);
+
+    while (isspace((unsigned char)*s->p))
+        s->p++;
+
+    /* ... keywords are not prefixes of symbols. */
+    if ((strncmp(s->p, str, len) != 0) ||
+        (is_ident(str[0]) && is_ident(s->p[len])))
+        return false;
+
+    s->p += len;
+
+    return true;
+}
+
+static bool scan_operand(struct scan *s, struct operand *op)
+{
+    char *start, *end;
+    size_t len;
+
+    while (isspace((unsigned char)*s->p))
+        s->p++;
+
+    op->symbol = false;
+    op->item = NULL;
+
+    if (*s->p == '"') {
+        start = ++s->p;
+
+        if ((s->p = strchr(start, '"')) == NULL)
+            return false;
+
+        *s->p++ = '\0';        /* ... terminate it in place. */
+        op->ttype = op->token.ttype = TT_DESCRIPTION;
+        op->token.TK_STRING = start;
+
+        return true;
+    }
+
+    for (start = s->p; is_ident(*s->p); s->p++) ;
+
+    if ((len = s->p - start) == 0)
+        return false;
+
+    if (((len == 4) && (strncmp(start, "true", 4) == 0)) ||
+        ((len == 5) && (strncmp(start, "false", 5) == 0))) {
+        op->ttype = op->token.ttype = TT_BOOL;
+        op->token.TK_BOOL = (len == 4);
+
+        return true;
+    }
+
+    op->token.TK_INTEGER = strtol(start, &end, 0);
+
+    if (end == s->p) {
+        op->ttype = op->token.ttype = TT_INTEGER;
+        return true;
+    }
+
+    op->symbol = true;
+    op->item = hash_get_item(s->db, sym_lookup(&s->db->symtab, start, len));
+    op->ttype = (op->item != NULL) ? item_ttype(op->item) : TT_INVALID;
+
+    return true;
+}
+
+static bool operand_token(struct db *db, struct operand *op, token_t *token)
+{
+    if (op->item == NULL) {
+        *token = op->token;
+        return true;
+    }
+
+    return visible_token(db, op->item, token);
+}
+
+static bool scan_leaf(struct scan *s)
+{
+    struct operand op1, op2;
+    token_t token1, token2;
+    enum expr_op op;
+
+    if (!scan_operand(s, &op1)) {
+        s->failed = true;
+        return false;
+    }
+
+    if (accept(s, "=="))
+        op = OP_EQUAL;
+    else if (accept(s, "!="))
+        op = OP_NEQUAL;
+    else {
+        if (!op1.symbol)
+            s->failed = true;
+
+        /* ... as 'BC_BOOL'. */
+        return (op1.ttype == TT_BOOL) && operand_token(s->db, &op1, &token1) &&
+            token1.TK_BOOL;
+    }
+
+    if (!scan_operand(s, &op2)) {
+        s->failed = true;
+        return false;
+    }
+
+    /* ... as 'link_leaf' and 'BC_EQUAL'. */
+    if ((op1.ttype == TT_INVALID) || (op1.ttype != op2.ttype) ||
+        !operand_token(s->db, &op1, &token1) || !operand_token(s->db, &op2, &token2))
+        return false;
+
+    return __eval_expr(token1, token2, op);
+}
+
+static bool scan_expr(struct scan *s);
+static bool scan_unary(struct scan *s)
+{
+    bool value;
+
+    if (accept(s, "NOT"))
+        return !scan_unary(s);
+
+    if (accept(s, "(")) {
+        value = scan_expr(s);
+
+        if (!accept(s, ")"))
+            s->failed = true;
+
+        return value;
+    }
+
+    return scan_leaf(s);
+}
+
+static bool scan_expr(struct scan *s)
+{
+    bool value = scan_unary(s);
+
+    while (!s->failed) {
+        if (accept(s, "&&"))
+            value = scan_unary(s) && value;
+        else if (accept(s, "||"))
+            value = scan_unary(s) || value;
+        else
+            break;
+    }
+
+    return value;
+}
+
+/* Evaluate the expression in 'str', which is changed; Returns -1 on syntax
+ * errors. 'db' must be evaluated, see 'eval_db'. */
+int eval_string(struct db *db, char *str, bool *value)
+{
+    struct scan s = { db, str, false };
+
+    *value = scan_expr(&s);
+
+    while (isspace((unsigned char)*s.p))
+        s.p++;
+
+    if (s.failed || (*s.p != '\0'))
+        return -1;
+
+    return SUCCESS;
+}
@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#define _GNU_SOURCE             /* ... for 'memmem'. */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Rewrite a dependency file generated by 'gcc -MMD', as 'fixdep' in Linux:
+ * The dependency on the autoconfig header is replaced with dependencies on
+ * the stamps of the symbols the prerequisites refer to, see 'stamps.c'. An
+ * object is rebuilt only if one of the symbols it uses changes.
+ *
+ *   fixdep <depfile> <target> <stamps dir> <autoconfig header>
+ *
+ * The result is written to stdout. Stamps are wrapped in '$(wildcard ...)',
+ * so symbols that are not defined do not break the build. */
+
+#define PREFIX "CONFIG_"
+
+struct symbols {
+    char **slots;
+    unsigned int nr_symbols, mask;
+};
+
+static unsigned int hash_str(const char *s, size_t len)
+{
+    unsigned int hash = 2166136261U;    /* FNV-1a. */
+
+    while (len-- > 0) {
+        hash ^= (unsigned char)*s++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+/* Add a symbol to the set, return 'true' if it is new. */
+static bool add_symbol(struct symbols *set, const char *name, size_t len)
+{
+    unsigned int i;
+    char *s;
+
+    if (2 * (set->nr_symbols + 1) > set->mask + 1) {
+        struct symbols n = { NULL, set->nr_symbols, 2 * set->mask + 1 };
+
+        if ((n.slots = calloc(n.mask + 1, sizeof(char *))) == NULL)
+            exit(EXIT_FAILURE);
+
+        for (i = 0; i <= set->mask; i++) {
+            unsigned int j;
+
+            if ((s = set->slots[i]) == NULL)
+                continue;
+
+            for (j = hash_str(s, strlen(s)) & n.mask; n.slots[j] != NULL;
+                j = (j + 1) & n.mask) ;
+
+            n.slots[j] = s;
+        }
+
+        free(set->slots);
+        *set = n;
+    }
+
+    for (i = hash_str(name, len) & set->mask; (s = set->slots[i]) != NULL;
+        i = (i + 1) & set->mask) {
+        if ((strncmp(s, name, len) == 0) && (s[len] == '\0'))
+            return false;
+    }
+
+    if ((set->slots[i] = strndup(name, len)) == NULL)
+        exit(EXIT_FAILURE);
+
+    set->nr_symbols++;
+
+    return true;
+}
+
+static inline bool is_ident(char c)
+{
+    return ((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z')) ||
+        ((c >= '0') && (c <= '9')) || (c == '_');
+}
+
+/* Print a stamp for every 'CONFIG_' symbol in 'file', once per symbol. */
+static void scan_file(struct symbols *set, const char *file, const char *dir)
+{
+    const char *p, *end, *sym;
+    struct stat st;
+    char *addr;
+    int fd;
+
+    if ((fd = open(file, O_RDONLY)) == -1) {
+        perror(file);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((fstat(fd, &st) == -1) || (st.st_size == 0)) {
+        close(fd);
+        return;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        perror(file);
+        exit(EXIT_FAILURE);
+    }
+
+    for (p = addr, end = addr + st.st_size;
+        (p = memmem(p, end - p, PREFIX, sizeof(PREFIX) - 1)) != NULL; p = sym) {
+
+        /* ... skip 'MY_CONFIG_A', it is another identifier. */
+        if ((p > addr) && is_ident(p[-1])) {
+            sym = p + 1;
+            continue;
+        }
+
+        for (sym = p + sizeof(PREFIX) - 1; (sym < end) && is_ident(*sym);
+            sym++) ;
+
+        if (add_symbol(set, p, sym - p))
+            printf("    $(wildcard %s/%.*s) \\\n", dir, (int)(sym - p), p);
+    }
+
+    munmap(addr, st.st_size);
+}
+
+int main(int argc, char *argv[])
+{
+    struct symbols set = { NULL, 0, 0 };
+    const char *dir, *header;
+    char *data = NULL, *p, *tok, **deps;
+    size_t i, n = 0, nr_deps = 0;
+    ssize_t size;
+    bool found = false;
+    FILE *fp;
+
+    if (argc != 5) {
+        fprintf(stderr,
+            "Use: %s <depfile> <target> <stamps dir> <autoconfig>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    dir = argv[3];
+    header = argv[4];
+
+    if ((set.slots = calloc((set.mask = 255) + 1, sizeof(char *))) == NULL)
+        return EXIT_FAILURE;
+
+    if ((fp = fopen(argv[1], "r")) == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    if ((size = getdelim(&data, &n, '\0', fp)) == -1) {
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    fclose(fp);
+
+    /* ... prerequisites follow the target, line continuations are blanks. */
+
+    if ((p = strstr(data, ": ")) == NULL)
+        p = data + size;
+    else
+        p += 2;
+
+    for (tok = p; tok < data + size; tok++) {
+        if ((tok[0] == '\\') && (tok[1] == '\n'))
+            tok[0] = tok[1] = ' ';
+    }
+
+    if ((deps = calloc(size / 2 + 1, sizeof(char *))) == NULL)
+        return EXIT_FAILURE;
+
+    printf("%s: \\\n", argv[2]);
+
+    for (tok = strtok(p, " \t\n"); tok != NULL; tok = strtok(NULL, " \t\n")) {
+        size_t len = strlen(tok), hlen = strlen(header);
+
+        /* ... the header may be named relative to another directory. */
+        if ((len >= hlen) && (strcmp(tok + len - hlen, header) == 0) &&
+            ((len == hlen) || (tok[len - hlen - 1] == '/'))) {
+            found = true;
+            continue;
+        }
+
+        printf("    %s \\\n", tok);
+        deps[nr_deps++] = tok;
+    }
+
+    /* Scan prerequisites only if they can see the header. */
+
+    for (i = 0; found && (i < nr_deps); i++)
+        scan_file(&set, deps[i], dir);
+
+    printf("\n");
+
+    free(deps);
+    free(data);
+
+    return EXIT_SUCCESS;
+}
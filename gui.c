@@ -3,6 +3,7 @@
 #include <ncurses.h>
 
 #include "ncurses.gui.h"
+#include "trace.h"
 #include "y.tab.h"
 
 static const char screen_title[] = { SCREEN_TITLE };
@@ -180,7 +181,9 @@ static int main_menu_driver(const char *menu_title, config_t choices[])
                 }
             }
 
+            trace_begin("draw_main_menu", menu_title);
             draw_main_menu(menu_title, choices, selected_row, choice_start);
+            trace_end();
 
             /* Processing special keys ... */
 
@@ -227,7 +230,7 @@ static int main_menu_driver(const char *menu_title, config_t choices[])
         (tmp); \
     })
 
-static config_t *get_config(menu_t *parent)
+static config_t *get_config(struct db *db, menu_t *parent)
 {
     static int conf_size = 0;
     static config_t *conf = NULL;
@@ -237,7 +240,7 @@ static config_t *get_config(menu_t *parent)
     int num = 1;
 
     LIST_FOREACH(menu, &parent->childs, sibling) {
-        if (eval_expr(menu->dependency)) {
+        if (eval_expr(db, menu->dependency)) {
 
             if (++num > conf_size) {
                 if ((conf = array_realloc(conf, num)) == NULL)
@@ -250,7 +253,7 @@ static config_t *get_config(menu_t *parent)
     }
 
     LIST_FOREACH(item, &parent->entries, node) {
-        if ((item->common.prompt != NULL) && eval_expr(item->common.dependency)) {
+        if ((item->common.prompt != NULL) && eval_item(db, item)) {
             struct extended_token *et;
 
             if (++num > conf_size) {
@@ -262,7 +265,8 @@ static config_t *get_config(menu_t *parent)
 
             if ((et = item_get_config_et(item)) != NULL) {
                 if (et->token.ttype == TT_BOOL)
-                    conf[num - 2].t = et->token.TK_BOOL ? CONF_YES : CONF_NO;
+                    conf[num - 2].t = item_bool(db, item) ?
+                        CONF_YES : CONF_NO;
                 else
                     conf[num - 2].t = CONF_INPUT;
             } else
@@ -279,14 +283,14 @@ static config_t *get_config(menu_t *parent)
     return conf;
 }
 
-static int open_radio_item(item_t *item)
+static int open_radio_item(struct db *db, item_t *item)
 {
     string_t *choices = NULL;
     struct extended_token *et;
     int num = 0, selected = -1;
 
     item_token_list_for_each_entry(et, item) {
-        if (!eval_expr(et->condition))
+        if (!eval_expr(db, et->condition))
             continue;
 
         choices = array_realloc(choices, ++num);
@@ -303,21 +307,21 @@ static int open_radio_item(item_t *item)
         } else                  /* and TT_DESCRIPTION. */
             choices[num - 1] = et->token.TK_STRING;
 
-        if (et->flags & TK_LIST_EF_SELECTED)
+        if (option_selected(db, item, et))
             selected = num - 1;
     }
 
     selected = radio_box("", choices, num, selected, (num > 5) ? 5 : num);
 
     if (selected != -1)
-        toggle_choice(item, choices[selected]);
+        toggle_choice(db, item, choices[selected]);
 
     free(choices);
 
     return SUCCESS;
 }
 
-int start_gui(int nr_pages)
+int start_gui(struct db *db, int nr_pages)
 {
 #define cur_config config[selected_row]
     config_t *config;
@@ -335,12 +339,16 @@ int start_gui(int nr_pages)
     init_pair(2, COLOR_BLACK, COLOR_BLUE);
 
     menu_t **stack = calloc(nr_pages, sizeof(menu_t *));
-    stack[index] = &main_menu;
+    stack[index] = &db->main_menu;
 
     while (TRUE) {
 
         /* Get the 'config' array for GUI from 'stack' top. */
-        if ((config = get_config(stack[index])) == NULL) {
+        trace_begin("get_config", stack[index]->prompt);
+        config = get_config(db, stack[index]);
+        trace_end();
+
+        if (config == NULL) {
             ret = -2;
             break;
         }
@@ -402,36 +410,38 @@ int start_gui(int nr_pages)
                 stack[++index] = cur_config.menu;
 
             else if (cur_config.t == CONF_YES)
-                toggle_config(cur_config.item);
+                toggle_config(db, cur_config.item);
 
             else if (cur_config.t == CONF_NO)
-                toggle_config(cur_config.item);
+                toggle_config(db, cur_config.item);
 
             else if (cur_config.t == CONF_INPUT) {
                 string_t input;
-                struct extended_token *et = item_get_config_et(cur_config.item);
+                token_t token = item_get_token(db, cur_config.item);
 
-                if (et->token.ttype == TT_INTEGER) {
+                if (token.ttype == TT_INTEGER) {
                     input =
                         int_input_box("", cur_config.item->common.prompt,
-                            et->token.info.number);
+                            token.info.number);
 
                     if (input != NULL)
-                        toggle_config(cur_config.item, strtol(input, NULL, 0));
+                        toggle_config(db, cur_config.item,
+                            strtol(input, NULL, 0));
 
                     free(input);
                 } else {        /* and TT_DESCRIPTION. */
                     input = input_box("",
-                            cur_config.item->common.prompt, et->token.TK_STRING,
+                            cur_config.item->common.prompt, token.TK_STRING,
                             "");
 
                     if (input != NULL)
-                        toggle_config(cur_config.item, input);
-                
-                    /* 'toggle_config' uses the input. So it will free the buffer. */
-                }               
+                        toggle_config(db, cur_config.item, input);
+
+                    /* 'toggle_config' copies the input. */
+                    free(input);
+                }
             } else              /* and 'CONF_RADIO'. */
-                open_radio_item(cur_config.item);
+                open_radio_item(db, cur_config.item);
         }
     }
 
@@ -0,0 +1,220 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <pthread.h>
+
+#include "db.h"
+#include "trace.h"
+#include "defaults.h"
+
+/* Included files are parsed on a pool of workers, each file to its own
+ * fragment, i.e. a private 'struct db'. Fragments are merged to the database
+ * on the calling thread in order of the 'files' list, which is the order
+ * files are parsed one at a time; Nested includes are queued as their parent
+ * fragment is merged. */
+
+struct fragment {
+    struct include *file;
+    struct db db;
+
+    int ret;
+    bool done;
+
+    struct timer timer;         /* ... of the parser thread, for '--stats'. */
+};
+
+struct pool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    struct fragment **fragments;
+    unsigned int nr_fragments, max_fragments;
+    unsigned int next;          /* Next fragment to parse. */
+
+    bool stop;
+};
+
+static void parse_fragment(struct fragment *fragment)
+{
+    stats_start(&fragment->timer, true);
+    fragment->ret = yy_parse_file(&fragment->db, fragment->file->file);
+    stats_stop(&fragment->timer);
+}
+
+static void *worker(void *arg)
+{
+    struct pool *pool = arg;
+    struct fragment *fragment;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (1) {
+        while (!pool->stop && (pool->next == pool->nr_fragments))
+            pthread_cond_wait(&pool->cond, &pool->lock);
+
+        if (pool->stop)
+            break;
+
+        fragment = pool->fragments[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+
+        parse_fragment(fragment);
+
+        pthread_mutex_lock(&pool->lock);
+        fragment->done = true;
+        pthread_cond_broadcast(&pool->cond);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/* Queue files in 'db->files' after 'last'; Returns the last file queued. */
+static struct include *queue_files(struct pool *pool, struct db *db,
+    struct include *last, int *ret)
+{
+    struct include *file;
+    LIST_HEAD *node;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (node = (last == NULL) ? db->files.next : last->node.next;
+        node != &db->files; node = node->next) {
+        struct fragment *fragment;
+
+        file = container_of(node, struct include, node);
+
+        if (pool->nr_fragments == pool->max_fragments) {
+            unsigned int n = (pool->max_fragments == 0) ?
+                64 : 2 * pool->max_fragments;
+            struct fragment **fragments = realloc(pool->fragments,
+                    n * sizeof(struct fragment *));
+
+            if (fragments == NULL)
+                goto failed;
+
+            pool->fragments = fragments;
+            pool->max_fragments = n;
+        }
+
+        if ((fragment = malloc(sizeof(struct fragment))) == NULL)
+            goto failed;
+
+        fragment->file = file;
+        fragment->done = false;
+        init_db(&fragment->db);
+        fragment->db.fragment = true;
+
+        pool->fragments[pool->nr_fragments++] = fragment;
+        last = file;
+    }
+
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return last;
+
+failed:
+    error_print("''alloc'' failed.\n");
+    *ret = -1;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return last;
+}
+
+/* Parse all files included in 'db' using 'nr_jobs' threads; The calling
+ * thread counts as one. */
+int parse_includes(struct db *db, int nr_jobs)
+{
+    struct pool pool = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    };
+
+    struct fragment *fragment;
+    struct include *last;
+    pthread_t *threads;
+    unsigned int i;
+    int n, nr_threads = 0, ret = SUCCESS;
+
+    if ((threads = calloc((nr_jobs > 1) ? nr_jobs : 1,
+                sizeof(pthread_t))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
+
+    trace_begin("parse_includes", NULL);
+    last = queue_files(&pool, db, NULL, &ret);
+
+    for (n = 1; (ret == SUCCESS) && (n < nr_jobs); n++) {
+        if (pthread_create(&threads[nr_threads], NULL, worker, &pool) != 0)
+            break;              /* ... continue with fewer workers. */
+
+        nr_threads++;
+    }
+
+    for (i = 0; ret == SUCCESS; i++) {
+        pthread_mutex_lock(&pool.lock);
+
+        if (i == pool.nr_fragments) {
+            pthread_mutex_unlock(&pool.lock);
+            break;
+        }
+
+        fragment = pool.fragments[i];
+
+        /* ... nobody picked it yet, parse it here. */
+        if (pool.next == i) {
+            pool.next++;
+            pthread_mutex_unlock(&pool.lock);
+
+            parse_fragment(fragment);
+
+            pthread_mutex_lock(&pool.lock);
+            fragment->done = true;
+        }
+
+        while (!fragment->done)
+            pthread_cond_wait(&pool.cond, &pool.lock);
+
+        pthread_mutex_unlock(&pool.lock);
+
+        printf("... config file: %s\n", fragment->file->file);
+        stats_phase("parse", fragment->file->file, &fragment->timer);
+
+        if (fragment->ret != 0) {
+            ret = -1;
+            break;
+        }
+
+        trace_begin("merge_fragment", fragment->file->file);
+        ret = merge_fragment(db, &fragment->db, fragment->file->menu);
+        trace_end();
+
+        if (ret == -1)
+            break;
+
+        last = queue_files(&pool, db, last, &ret);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    while (nr_threads > 0)
+        pthread_join(threads[--nr_threads], NULL);
+
+    for (i = 0; i < pool.nr_fragments; i++) {
+        release_db(&pool.fragments[i]->db);
+        free(pool.fragments[i]);
+    }
+
+    free(pool.fragments);
+    free(threads);
+
+    trace_end();
+
+    return ret;
+}
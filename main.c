@@ -3,13 +3,19 @@
 #include <unistd.h>
 #include <libgen.h>
 #include <getopt.h>
-#include <search.h>
 
 #include "db.h"
+#include "stats.h"
+#include "trace.h"
 #include "defaults.h"
 
-extern int start_gui(int);
-extern int yy_parse_file(const char *filename);
+extern int start_gui(struct db *, int);
+extern int serve_config(const char *, const char *, const char *,
+    const char *, int);
+extern int batch_config(struct db *, const char *, int);
+extern int rand_config(struct db *, unsigned long, unsigned int, const char *,
+    const char *, const char *, int);
+extern int all_config(struct db *, bool, const char *, const char *);
 
 static void print_help(char *pname)
 {
@@ -18,14 +24,105 @@ static void print_help(char *pname)
     printf("  [--gui]              open the GUI\n");
     printf("  [--config file]      choose input config file\n");
     printf("  [--sys-config file]  choose output autoconfig file\n");
+    printf("  [--jobs n]           parse included files on 'n' threads\n");
+    printf("  [--stamps dir]       touch per-symbol stamps in 'dir' for 'fixdep'\n");
+    printf("  [--stats]            print time of phases and counters on exit\n");
+    printf("  [--trace file]       write trace events to 'file', see 'trace.h'\n");
+    printf("  [--set SYMBOL=value] set a value of '.old.config', repeatable\n");
+    printf("  [--set-from file]    set values of 'SYMBOL=value' lines in 'file'\n");
+    printf("  [--serve socket]     answer requests on a Unix socket, see 'serve.c'\n");
+    printf("  [--batch list]       write headers of configurations in 'list', see 'batch.c'\n");
+    printf("  [--randconfig[=seed]] write a random '.old.config', see 'rand.c'\n");
+    printf("  [--count n]          write 'n' random configurations, with '--randconfig'\n");
+    printf("  [--allyes]           write '.old.config' with all visible BOOLs 'true'\n");
+    printf("  [--allno]            write '.old.config' with all visible BOOLs 'false'\n");
 }
 
 int gen_old_config = 0, need_gui = 0;
+int all_values = -1;            /* ... 1 for '--allyes' and 0 for '--allno'. */
+
+/* Values of '--set' and '--set-from', in order; They are applied together,
+ * with a single propagation of selects. */
+
+struct assignment {
+    string_t arg;
+    bool file;                  /* ... 'arg' is a file of assignments. */
+};
+
+static struct assignment *assignments;
+static unsigned int nr_assignments;
+
+static int add_assignment(string_t arg, bool file)
+{
+    struct assignment *a = realloc(assignments,
+            (nr_assignments + 1) * sizeof(struct assignment));
+
+    if (a == NULL)
+        return -1;
+
+    assignments = a;
+
+    /* ... before changing CWD, 'file' is relative to it. */
+    if (file && ((arg = realpath(arg, NULL)) == NULL))
+        return -1;
+
+    a[nr_assignments].arg = arg;
+    a[nr_assignments++].file = file;
+
+    return SUCCESS;
+}
+
+/* Touch the stamps of the header written of 'db', if '--stamps' is set. */
+static int write_stamps(struct db *db, const char *dir)
+{
+    struct timer timer;
+
+    if (dir == NULL)
+        return SUCCESS;
+
+    stats_start(&timer, false);
+    if (update_stamps(db, dir) == -1) {
+        perror("Updating stamps");
+        return -1;
+    }
+
+    stats_phase("stamps", dir, &timer);
+
+    return SUCCESS;
+}
+
+static int set_values(struct db *db)
+{
+    struct assignment *a;
+    unsigned int i;
+
+    for (i = 0; i < nr_assignments; i++) {
+        a = &assignments[i];
+
+        if ((a->file ? set_config_file(db, a->arg) :
+                set_config(db, a->arg)) == -1) {
+            error_print("Setting '%s' failed.\n", a->arg);
+            return -1;
+        }
+    }
+
+    return SUCCESS;
+}
 
 int main(int argc, char *argv[])
 {
-    struct include *file;
+    struct db db;
     string_t in_filename = _IN_FILE, out_filename = _OUT_FILE;
+    string_t in_dirname, in_basename, stamps_dir = NULL, socket_file = NULL;
+    string_t in_root, batch_list = NULL;
+    int nr_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    bool randconfig = false;
+    unsigned long seed = time(NULL) ^ getpid();
+    unsigned int count = 0;     /* ... 1 unless '--count' is set. */
+    char *end;
+    struct timer timer;
+    unsigned int i;
+    int ret;
 
     while (1) {
         static struct option long_options[] = {
@@ -33,7 +130,20 @@ int main(int argc, char *argv[])
             {"gui", no_argument, &need_gui, 1},
             {"config", required_argument, NULL, 'i'},
             {"sys-config", required_argument, NULL, 'o'},
-            {"help", required_argument, NULL, 'h'}
+            {"jobs", required_argument, NULL, 'j'},
+            {"stamps", required_argument, NULL, 's'},
+            {"stats", no_argument, NULL, 'S'},
+            {"trace", required_argument, NULL, 't'},
+            {"set", required_argument, NULL, 'v'},
+            {"set-from", required_argument, NULL, 'f'},
+            {"serve", required_argument, NULL, 'd'},
+            {"batch", required_argument, NULL, 'b'},
+            {"randconfig", optional_argument, NULL, 'r'},
+            {"count", required_argument, NULL, 'n'},
+            {"allyes", no_argument, &all_values, 1},
+            {"allno", no_argument, &all_values, 0},
+            {"help", required_argument, NULL, 'h'},
+            {0, 0, 0, 0}
         };
 
         int c = getopt_long(argc, argv, "", long_options, NULL);
@@ -53,6 +163,72 @@ int main(int argc, char *argv[])
             out_filename = optarg;
             break;
 
+        case 'j':
+            nr_jobs = atoi(optarg);
+            break;
+
+        case 's':
+            stamps_dir = optarg;
+            break;
+
+        case 'S':
+            stats_enabled = true;
+            break;
+
+        case 't':
+            /* ... before changing CWD, 'file' is relative to it. */
+            if (trace_open(optarg) == -1) {
+                perror("Opening trace file");
+                goto failed;
+            }
+
+            break;
+
+        case 'd':
+            socket_file = optarg;
+            break;
+
+        case 'b':
+            /* ... before changing CWD, 'list' is relative to it. */
+            if ((batch_list = realpath(optarg, NULL)) == NULL) {
+                perror(optarg);
+                goto failed;
+            }
+
+            break;
+
+        case 'r':
+            randconfig = true;
+
+            if (optarg != NULL) {
+                seed = strtoul(optarg, &end, 0);
+
+                if ((optarg[0] == '\0') || (end[0] != '\0')) {
+                    error_print("Invalid seed: %s.\n", optarg);
+                    goto failed;
+                }
+            }
+
+            break;
+
+        case 'n':
+            if (atoi(optarg) <= 0) {
+                error_print("Invalid count: %s.\n", optarg);
+                goto failed;
+            }
+
+            count = atoi(optarg);
+            break;
+
+        case 'v':
+        case 'f':
+            if (add_assignment(optarg, c == 'f') == -1) {
+                perror(optarg);
+                goto failed;
+            }
+
+            break;
+
         case 'h':
             print_help(argv[0]);
             return SUCCESS;
@@ -60,59 +236,207 @@ int main(int argc, char *argv[])
         case '?':
         default:
             print_help(argv[0]);
-            return -1;
+            goto failed;
         }
     }
 
-    hcreate(256);
+    /* ... other modes do not read '.old.config', so values are not set. */
+    if ((nr_assignments > 0) && ((socket_file != NULL) ||
+            (batch_list != NULL) || randconfig || (all_values != -1) ||
+            gen_old_config)) {
+        error_print("'--set' and '--set-from' are not used with '--serve', "
+            "'--batch', '--randconfig', '--allyes', '--allno' or '--dump'.\n");
+        goto failed;
+    }
 
-    /* ... main configuration file. */
-    if (yy_parse_file(in_filename) != 0)
-        return -1;
+    if ((count > 0) && !randconfig) {
+        error_print("'--count' is used with '--randconfig' only.\n");
+        goto failed;
+    }
+
+    /* ... stamps are of '--sys-config', not written with 'n' > 1. */
+    if ((count > 1) && (stamps_dir != NULL)) {
+        error_print("'--stamps' is not used with '--count' of more than one "
+            "configuration.\n");
+        goto failed;
+    }
+
+    /* ... it does not return, unless it fails. */
+    if ((socket_file != NULL) && (serve_config(socket_file, in_filename,
+                out_filename, stamps_dir, nr_jobs) == -1)) {
+        perror("Serving configuration");
+        goto failed;
+    }
 
-    if (chdir(dirname(in_filename)) == -1) {
+    init_db(&db);
+
+    /* ... included files are relative to the main configuration file. */
+    in_dirname = strdup(in_filename);
+    in_basename = strdup(in_filename);
+    in_root = basename(in_basename);
+
+    if (chdir(dirname(in_dirname)) == -1) {
         perror("Changing CWD.");
-        return -1;
+        goto failed;
     }
 
-    LIST_FOREACH(file, &files, node) {
-        curr_menu = file->menu;
+    /* ... phases are timed with process CPU time; Included files are timed
+     * on their parser threads, see 'include.c'. */
 
-        if (yy_parse_file(file->file) != 0)
-            return -1;
+    stats_start(&timer, false);
+
+    if (load_cache(&db, _CACHE_FILE, in_root) == 0) {
+        printf("... config cache: %s\n", _CACHE_FILE);
+        stats_phase("cache", _CACHE_FILE, &timer);
+
+    } else {
+
+        /* ... main configuration file. */
+        printf("... config file: %s\n", in_filename);
+        stats_start(&timer, false);
+        if (yy_parse_file(&db, in_root) != 0)
+            goto failed;
+
+        stats_phase("parse", in_filename, &timer);
+
+        stats_start(&timer, false);
+        if (parse_includes(&db, nr_jobs) == -1)
+            goto failed;
+
+        stats_phase("includes", NULL, &timer);
+
+        /* ... resolve symbols in expressions, once all files are parsed. */
+        stats_start(&timer, false);
+        trace_begin("link_db", NULL);
+        ret = link_db(&db);
+        trace_end();
+
+        if (ret == -1)
+            goto failed;
+
+        stats_phase("link", NULL, &timer);
+
+        stats_start(&timer, false);
+        if (save_cache(&db, _CACHE_FILE, in_root) == -1)
+            perror("Writing '" _CACHE_FILE "'");
+
+        stats_phase("cache", _CACHE_FILE, &timer);
     }
 
-    if (gen_old_config == 1) {
-        if (create_config_file(".old.config") == -1) {
+    /* ... configurations of the list are loaded to copies of 'db'. */
+    if (batch_list != NULL) {
+        stats_start(&timer, false);
+        if (batch_config(&db, batch_list, nr_jobs) == -1)
+            goto failed;
+
+        stats_phase("batch", batch_list, &timer);
+    } else if (randconfig) {
+        printf("... random seed: %lu\n", seed);
+
+        stats_start(&timer, false);
+        if (rand_config(&db, seed, (count > 0) ? count : 1, ".old.config",
+                out_filename, stamps_dir, nr_jobs) == -1)
+            goto failed;
+
+        stats_phase("randconfig", NULL, &timer);
+    } else if (all_values != -1) {
+        stats_start(&timer, false);
+        if (all_config(&db, all_values == 1, ".old.config", out_filename) == -1)
+            goto failed;
+
+        stats_phase(all_values ? "allyes" : "allno", NULL, &timer);
+
+        if (write_stamps(&db, stamps_dir) == -1)
+            goto failed;
+    } else if (gen_old_config == 1) {
+        stats_start(&timer, false);
+        if (create_config_file(&db, ".old.config") == -1) {
             perror("Generateing '.old.config'");
-            return -1;
+            goto failed;
         }
 
+        stats_phase("write", ".old.config", &timer);
         printf("Generateing '.old.config': Success\n");
     } else {
-        if (read_config_file(".old.config") == -1) {
+        stats_start(&timer, false);
+        if (load_config_file(&db, ".old.config") == -1) {
             perror("Opening '.old.config'");
-            return -1;
+            goto failed;
+        }
+
+        stats_phase("read", ".old.config", &timer);
+
+        /* ... values of '.old.config' and '--set' are propagated at once. */
+        stats_start(&timer, false);
+        if (set_values(&db) == -1)
+            goto failed;
+
+        apply_config(&db);
+        stats_phase("set", NULL, &timer);
+
+        stats_start(&timer, false);
+        eval_db(&db);
+        stats_phase("eval", NULL, &timer);
+
+        if (nr_assignments > 0) {
+            stats_start(&timer, false);
+            if (write_config_file(&db, ".old.config") == -1) {
+                perror("Writing '.old.config'");
+                goto failed;
+            }
+
+            stats_phase("write", ".old.config", &timer);
         }
 
         /* ... open up GUI: 25 pages. */
         if (need_gui == 1) {
-            if (start_gui(25) == 0) {
-                if (write_config_file(".old.config") == -1) {
+            if (start_gui(&db, 25) == 0) {
+                stats_start(&timer, false);
+                if (write_config_file(&db, ".old.config") == -1) {
                     perror("Writing '.old.config'");
-                    return -1;
+                    goto failed;
                 }
-            } else
+
+                stats_phase("write", ".old.config", &timer);
+            } else {
+                trace_close();
                 return SUCCESS;
+            }
         }
 
-        if (build_autoconfig(out_filename) == -1) {
+        stats_start(&timer, false);
+        if (build_autoconfig(&db, out_filename) == -1) {
             perror("Building autoconfig:");
-            return -1;
+            goto failed;
         }
 
+        stats_phase("header", out_filename, &timer);
         printf("Writing %s: Success\n", out_filename);
+
+        if (write_stamps(&db, stamps_dir) == -1)
+            goto failed;
     }
 
+    print_stats(stderr);
+    trace_close();
+
+    release_db(&db);
+
+    for (i = 0; i < nr_assignments; i++) {
+        if (assignments[i].file)
+            free(assignments[i].arg);
+    }
+
+    free(assignments);
+    free(batch_list);
+    free(in_dirname);
+    free(in_basename);
+
     return SUCCESS;
+
+failed:
+    /* ... the trace is complete on errors, as well. */
+    trace_close();
+
+    return -1;
 }
@@ -35,6 +35,20 @@ static inline void LIST_INSERT_TAIL(LIST_HEAD *entry, LIST_HEAD *head)
     __list_insert(entry, head->prev, head);
 }
 
+/* Move all entries of 'list' to the tail of 'head'; 'list' is left dangling. */
+static inline void LIST_SPLICE_TAIL(LIST_HEAD *list, LIST_HEAD *head)
+{
+    LIST_HEAD *first = list->next, *last = list->prev;
+
+    if (first == list)
+        return;
+
+    first->prev = head->prev;
+    head->prev->next = first;
+    last->next = head;
+    head->prev = last;
+}
+
 #define LIST_FIRST(ptr, type, member) \
     container_of((ptr)->next, type, member)
 
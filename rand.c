@@ -0,0 +1,398 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <pthread.h>
+#include <errno.h>
+
+#include "db.h"
+#include "defaults.h"
+#include "y.tab.h"
+
+/* Random configurations, '--randconfig[=seed]'. A configuration starts with
+ * the defaults, as '--dump' writes them, and items are visited in
+ * 'eval_order', i.e. after the items they depend on: A visible 'BOOL' item
+ * is set to 'true' or 'false' at random and its selects are propagated, and
+ * a visible choice is set to one of its options whose condition holds.
+ * Invisible items, and integers and strings, keep their defaults.
+ *
+ * A select may show or hide an item visited already, e.g. 'depends NOT S' of
+ * an item before 'C', which selects 'S'. Items that read a changed item are
+ * queued on 'rank' and visited again before the next item in 'eval_order',
+ * see 'walk_next', so there is a single pass and an item is only visited
+ * again when an item it reads changes; An item is set once.
+ *
+ * '--count n' writes 'n' configurations to '.old.config.<k>' and
+ * '<sys-config>.<k>'; Configuration 'k' is of the seed 'seed + k', so it is
+ * the configuration of '--randconfig=<seed + k>'. As in 'batch.c', workers of
+ * the pool share the linked tree, each with a view of its own, and restore
+ * the defaults of the database for every configuration.
+ *
+ * '--allyes' and '--allno' walk items the same way, with every visible 'BOOL'
+ * item set to 'true', or 'false', and choices at their default options. */
+
+struct randconfig {
+    struct db *db;              /* ... at the defaults, and not written. */
+    unsigned long seed;
+
+    const char *config, *header, *stamps;
+    int *errs;                  /* ... 0 if a configuration is written. */
+    unsigned int count;
+    unsigned int next;          /* Next configuration to write. */
+};
+
+/* 'splitmix64', 64 random bits are used one by one. */
+struct random {
+    uint64_t state, bits;
+    unsigned int nr_bits;
+};
+
+static uint64_t random_next(struct random *r)
+{
+    uint64_t z = (r->state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+    return z ^ (z >> 31);
+}
+
+static bool random_bit(struct random *r)
+{
+    if (r->nr_bits == 0) {
+        r->bits = random_next(r);
+        r->nr_bits = 64;
+    }
+
+    r->nr_bits--;
+
+    return (r->bits >> r->nr_bits) & 1;
+}
+
+/* Select one of the options of 'item' whose condition holds. */
+static void random_option(struct db *db, item_t *item, struct random *r)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < item->nr_options; i++) {
+        if (eval_expr(db, item->options[i]->condition))
+            n++;
+    }
+
+    if (n == 0)
+        return;
+
+    n = random_next(r) % n;
+
+    for (i = 0; i < item->nr_options; i++) {
+        if (eval_expr(db, item->options[i]->condition) && (n-- == 0))
+            break;
+    }
+
+    item_set_data(db, item, i);
+    invalidate_item(db, item);
+}
+
+/* A pass over the items of a database in 'eval_order'; Items visited
+ * already are queued again on 'rank' if an item they read changes. Arrays
+ * are indexed by 'rank'. */
+struct walk {
+    item_t **queue;
+    unsigned int nr_queued;
+    unsigned int next;          /* ... in 'eval_order'. */
+
+    bool *queued, *visible;     /* ... as it was last visited. */
+    bool *done;                 /* ... set by 'random_config'. */
+};
+
+static int init_walk(struct db *db, struct walk *w)
+{
+    unsigned int n = db->nr_items;
+
+    if ((w->queue = malloc(n * (sizeof(item_t *) + 3 * sizeof(bool)) + 1)) ==
+        NULL)
+        return -1;
+
+    w->queued = (bool *)(w->queue + n);
+    w->visible = w->queued + n;
+    w->done = w->visible + n;
+
+    return SUCCESS;
+}
+
+static void start_walk(struct db *db, struct walk *w)
+{
+    w->nr_queued = w->next = 0;
+
+    memset(w->queued, 0, db->nr_items * sizeof(bool));
+    memset(w->done, 0, db->nr_items * sizeof(bool));
+}
+
+/* 'item' has changed; Queue the items reading it that are visited already,
+ * the others are visited in 'eval_order' anyway. */
+static void walk_readers(struct walk *w, item_t *item)
+{
+    unsigned int i;
+    item_t *reader;
+
+    for (i = 0; i < item->nr_readers; i++) {
+        if (((reader = reader_item(item, i)) == NULL) ||
+            (reader->rank >= w->next) || w->queued[reader->rank])
+            continue;
+
+        w->queued[reader->rank] = true;
+        rank_push(w->queue, &w->nr_queued, reader);
+    }
+}
+
+/* Next visible item to visit, NULL at the end. Queued items come before the
+ * next item in 'eval_order' if they are before it, so every item is visited
+ * after the items it depends on. */
+static item_t *walk_next(struct db *db, struct walk *w)
+{
+    item_t *item;
+    bool visible;
+
+    while (true) {
+        if ((w->nr_queued > 0) && (w->queue[0]->rank < w->next)) {
+            item = rank_pop(w->queue, &w->nr_queued);
+            w->queued[item->rank] = false;
+
+            /* ... items reading it are visited already, too. */
+            if ((visible = eval_item(db, item)) != w->visible[item->rank])
+                walk_readers(w, item);
+
+        } else if (w->next < db->nr_items) {
+            item = db->eval_order[w->next++];
+            visible = eval_item(db, item);
+
+        } else
+            return NULL;
+
+        w->visible[item->rank] = visible;
+
+        if (visible)
+            return item;
+    }
+}
+
+/* Set the own value of the 'BOOL' item 'item' and propagate its selects. */
+static void set_bool(struct db *db, struct walk *w, item_t *item, bool value)
+{
+    unsigned int i, n;
+
+    if (item_own(db, item) == value)
+        return;
+
+    item_set_own(db, item, value);
+    n = update_selects(db, item);
+
+    for (i = 0; i < n; i++)
+        walk_readers(w, db->select_queue[i]);
+}
+
+/* Set items of 'db' at random. */
+static void random_config(struct db *db, unsigned long seed, struct walk *w)
+{
+    struct extended_token *et;
+    struct random r = { seed, 0, 0 };
+    item_t *item;
+
+    start_walk(db, w);
+
+    while ((item = walk_next(db, w)) != NULL) {
+        if (w->done[item->rank])
+            continue;
+
+        w->done[item->rank] = true;
+
+        if ((et = item_get_config_et(item)) == NULL) {
+            random_option(db, item, &r);
+            walk_readers(w, item);
+
+        } else if (et->token.ttype == TT_BOOL)
+            set_bool(db, w, item, random_bit(&r));
+    }
+
+    eval_db(db);
+}
+
+static char *output_path(const char *file, unsigned int count,
+    unsigned int k)
+{
+    size_t n = strlen(file) + 16;
+    char *path;
+
+    if (count == 1)
+        return strdup(file);
+
+    if ((path = malloc(n)) != NULL)
+        snprintf(path, n, "%s.%u", file, k);
+
+    return path;
+}
+
+static int write_random(struct db *db, struct randconfig *rc, unsigned int k,
+    struct walk *w)
+{
+    char *config, *header;
+    int ret = -1;
+
+    config = output_path(rc->config, rc->count, k);
+    header = output_path(rc->header, rc->count, k);
+
+    if ((config == NULL) || (header == NULL))
+        errno = ENOMEM;
+    else {
+        random_config(db, rc->seed + k, w);
+
+        /* ... stamps are of a single configuration, see 'main.c'. */
+        if ((write_config_file(db, config) == SUCCESS) &&
+            (build_autoconfig(db, header) == SUCCESS) &&
+            ((rc->stamps == NULL) || (update_stamps(db, rc->stamps) == 0)))
+            ret = SUCCESS;
+    }
+
+    free(config);
+    free(header);
+
+    return ret;
+}
+
+static void *worker(void *arg)
+{
+    struct randconfig *rc = arg;
+    struct walk w = { NULL };
+    struct db db;
+    unsigned int k;
+
+    /* ... configurations left by a failed worker are written by others. */
+    if ((share_db(&db, rc->db) == -1) || (init_walk(&db, &w) == -1)) {
+        release_db(&db);
+        return NULL;
+    }
+
+    while ((k = __atomic_fetch_add(&rc->next, 1, __ATOMIC_RELAXED)) <
+        rc->count) {
+        rc->errs[k] = (write_random(&db, rc, k, &w) == SUCCESS) ? 0 : errno;
+
+        restore_values(&db, &rc->db->values);
+    }
+
+    free(w.queue);
+    release_db(&db);
+
+    return NULL;
+}
+
+/* Write the configuration with every visible 'BOOL' item set to 'value' to
+ * 'config' and 'header'; 'db' is linked and no configuration is loaded to it.
+ *
+ * Items are visited as '--randconfig' visits them: Own values only change to
+ * 'value', so each changes once, and an item is visited again only when an
+ * item it reads changes. */
+int all_config(struct db *db, bool value, const char *config,
+    const char *header)
+{
+    struct walk w;
+    item_t *item;
+
+    if (init_walk(db, &w) == -1) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
+
+    default_choices(db);
+    apply_config(db);
+    start_walk(db, &w);
+
+    while ((item = walk_next(db, &w)) != NULL) {
+        if (item_ttype(item) == TT_BOOL)
+            set_bool(db, &w, item, value);
+    }
+
+    free(w.queue);
+    eval_db(db);
+
+    if (write_config_file(db, config) == -1) {
+        perror(config);
+        return -1;
+    }
+
+    if (build_autoconfig(db, header) == -1) {
+        perror(header);
+        return -1;
+    }
+
+    printf("Writing %s: Success\n", header);
+
+    return SUCCESS;
+}
+
+/* Write 'count' random configurations of 'seed' to 'config' and 'header', see
+ * above, on 'nr_jobs' threads; The calling thread counts as one. 'db' is
+ * linked and no configuration is loaded to it. Stamps are touched in 'stamps',
+ * if it is not NULL, for a single configuration. */
+int rand_config(struct db *db, unsigned long seed, unsigned int count,
+    const char *config, const char *header, const char *stamps, int nr_jobs)
+{
+    struct randconfig rc = {
+        .db = db,
+        .seed = seed,
+        .config = config,
+        .header = header,
+        .stamps = stamps,
+        .count = count
+    };
+    pthread_t *threads = NULL;
+    unsigned int k;
+    int n, nr_threads = 0, ret = -1;
+    char *path;
+
+    if (((rc.errs = malloc(count * sizeof(int))) == NULL) ||
+        ((threads = calloc((nr_jobs > 1) ? nr_jobs : 1,
+                    sizeof(pthread_t))) == NULL)) {
+        error_print("''alloc'' failed.\n");
+        goto out;
+    }
+
+    /* ... views copy evaluated values, see 'share_db'. */
+    default_choices(db);
+    apply_config(db);
+    eval_db(db);
+
+    for (k = 0; k < count; k++)
+        rc.errs[k] = ECANCELED; /* ... until a worker writes it. */
+
+    for (n = 1; (n < nr_jobs) && (n < (int)count); n++) {
+        if (pthread_create(&threads[nr_threads], NULL, worker, &rc) != 0)
+            break;              /* ... continue with fewer workers. */
+
+        nr_threads++;
+    }
+
+    worker(&rc);
+
+    while (nr_threads > 0)
+        pthread_join(threads[--nr_threads], NULL);
+
+    ret = SUCCESS;
+
+    for (k = 0; k < count; k++) {
+        path = output_path(header, count, k);
+
+        if (rc.errs[k] == 0)
+            printf("Writing %s: Success\n", path ? path : header);
+        else {
+            errno = rc.errs[k];
+            perror(path ? path : header);
+            ret = -1;
+        }
+
+        free(path);
+    }
+
+out:
+    free(rc.errs);
+    free(threads);
+
+    return ret;
+}
@@ -0,0 +1,263 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include "db.h"
+#include "trace.h"
+#include "defaults.h"
+#include "y.tab.h"
+
+/* Targets of 'select' keywords are resolved to items once, after parsing,
+ * with the reverse edges, i.e. the items selecting an item. Select cycles are
+ * reported when linking, as dependency cycles are.
+ *
+ * A 'BOOL' item has its own value, set by the user or '.old.config', and it
+ * is 'true' if its own value is 'true' or a 'true' item selects it; The value
+ * is kept in the bits of its page, see 'values.h'. 'refcount' is the number
+ * of 'true' items selecting the item.
+ *
+ * A change is propagated with a worklist: Every item changes at most once
+ * as a change only turns items on or only off, so it is O(V + E). The whole
+ * configuration is recomputed in 'select_order', where items come after the
+ * items selecting them. */
+
+/* 'item' selects 'target' if it is a 'BOOL' item. */
+static item_t *link_target(struct db *db, struct extended_token *et)
+{
+    item_t *target = hash_get_item(db, et->token.TK_SYMBOL);
+    struct extended_token *e;
+
+    if ((target == NULL) || ((e = item_get_config_et(target)) == NULL) ||
+        (e->token.ttype != TT_BOOL)) {
+        debug_print("Incompatible select: %s.\n",
+            sym_name(&db->symtab, et->token.TK_SYMBOL));
+        return NULL;
+    }
+
+    return target;
+}
+
+/* Fill 'selects' and 'selectors' of items; Arrays are NULL when counting. */
+static void __link_selects(struct db *db)
+{
+    item_t *item, *target;
+    struct token_list *tp;
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        if (item_get_config_et(item) == NULL)
+            continue;
+
+        token_list_for_each(tp, item->tk_list->next) {
+            if ((target = link_target(db, item_token_list_entry(tp))) == NULL)
+                continue;
+
+            if (item->selects != NULL)
+                item->selects[item->nr_selects] = target;
+
+            if (target->selectors != NULL)
+                target->selectors[target->nr_selectors] = item;
+
+            item->nr_selects++;
+            target->nr_selectors++;
+        }
+    }
+}
+
+#define MARK_NULL 0
+#define MARK_VISITING 1
+#define MARK_DONE 2
+
+struct select_frame {
+    item_t *item;
+    unsigned int n;             /* Next target to visit. */
+};
+
+/* Depth-first sort of items on the select graph; Items are added to
+ * 'select_order' from the end, after all items they select. */
+
+static int sort_selects(struct db *db)
+{
+    struct select_frame *stack, *f;
+    unsigned char *marks;           /* ... indexed by 'id' of items. */
+    item_t *root, *item;
+    unsigned int sp, i, n = db->nr_items;
+
+    if (((stack = malloc((n + 1) * sizeof(struct select_frame))) == NULL) ||
+        ((marks = calloc(nr_symbols(&db->symtab) + 1, 1)) == NULL)) {
+        error_print("''alloc'' failed.\n");
+        free(stack);
+        return -1;
+    }
+
+    LIST_FOREACH(root, &db->symtable, sym_node) {
+        if (marks[root->id] != MARK_NULL)
+            continue;
+
+        marks[root->id] = MARK_VISITING;
+        stack[0].item = root;
+        stack[0].n = 0;
+        sp = 1;
+
+        while (sp > 0) {
+            f = &stack[sp - 1];
+
+            if (f->n < f->item->nr_selects) {
+                item = f->item->selects[f->n++];
+
+                if (marks[item->id] == MARK_DONE)
+                    continue;
+
+                if (marks[item->id] == MARK_VISITING) {
+                    error_print("Select cycle:");
+
+                    for (i = sp; stack[--i].item != item;) ;
+                    for (; i < sp; i++)
+                        fprintf(stderr, " %s ->", stack[i].item->common.symbol);
+
+                    fprintf(stderr, " %s.\n", item->common.symbol);
+                    free(stack);
+                    free(marks);
+                    return -1;
+                }
+
+                marks[item->id] = MARK_VISITING;
+                stack[sp].item = item;
+                stack[sp++].n = 0;
+
+            } else {
+                marks[f->item->id] = MARK_DONE;
+                db->select_order[--n] = f->item;
+                sp--;
+            }
+        }
+    }
+
+    free(stack);
+    free(marks);
+
+    return SUCCESS;
+}
+
+int link_selects(struct db *db)
+{
+    item_t *item, **items;
+    unsigned int n = 0;
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        item->selects = item->selectors = NULL;
+        item->nr_selects = item->nr_selectors = 0;
+    }
+
+    /* First pass counts edges with arrays set to NULL. */
+    __link_selects(db);
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        n += item->nr_selects + item->nr_selectors;
+    }
+
+    if (((items = arena_alloc(&db->node_arena,
+                    n * sizeof(item_t *))) == NULL) ||
+        ((db->select_order = arena_alloc(&db->node_arena,
+                    db->nr_items * sizeof(item_t *))) == NULL)) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        item->selects = items;
+        items += item->nr_selects;
+        item->selectors = items;
+        items += item->nr_selectors;
+        item->nr_selects = item->nr_selectors = 0;
+    }
+
+    __link_selects(db);
+
+    return sort_selects(db);
+}
+
+/* Set the value of 'item' from its own value and 'refcount'; Returns 'true'
+ * if it has changed. */
+static bool select_value(struct db *db, item_t *item)
+{
+    bool value = item_own(db, item) || (item_refcount(db, item) > 0);
+
+    if (item_bool(db, item) == value)
+        return false;
+
+    item_set_bool(db, item, value);
+    invalidate_item(db, item);
+
+    return true;
+}
+
+/* Own value of the 'BOOL' item 'item' has changed; Update it and the items
+ * it selects. Returns the number of items whose value has changed, they are
+ * at the head of 'select_queue'. */
+unsigned int update_selects(struct db *db, item_t *item)
+{
+    item_t **queue = db->select_queue;
+    unsigned int head = 0, tail = 0, i;
+
+    if (!select_value(db, item))
+        return 0;
+
+    trace_begin("update_selects", item->common.symbol);
+    queue[tail++] = item;
+
+    while (head < tail) {
+        item = queue[head++];
+
+        for (i = 0; i < item->nr_selects; i++) {
+            item_t *target = item->selects[i];
+
+            stat_inc(STAT_SELECT);
+
+            item_set_refcount(db, target, item_refcount(db, target) +
+                (item_bool(db, item) ? 1 : -1));
+
+            /* ... all changes are in the same direction, so an item is
+             * queued at most once. */
+
+            if (select_value(db, target))
+                queue[tail++] = target;
+        }
+    }
+
+    trace_end();
+
+    return tail;
+}
+
+/* Recompute the values of all 'BOOL' items and their 'refcount' from their
+ * own values. */
+void apply_selects(struct db *db)
+{
+    unsigned int i, j, refcount;
+    item_t *item;
+
+    trace_begin("apply_selects", NULL);
+
+    for (i = 0; i < db->nr_items; i++) {
+        item = db->select_order[i];
+
+        if (item_get_config_et(item) == NULL)
+            continue;
+
+        /* ... items selecting 'item' are done, already. */
+        refcount = 0;
+
+        for (j = 0; j < item->nr_selectors; j++) {
+            stat_inc(STAT_SELECT);
+
+            if (item_bool(db, item->selectors[j]))
+                refcount++;
+        }
+
+        /* ... a shared page is copied only if a value changes. */
+        item_set_refcount(db, item, refcount);
+
+        if (item_ttype(item) == TT_BOOL)
+            select_value(db, item);
+    }
+
+    trace_end();
+}
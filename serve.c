@@ -0,0 +1,609 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <libgen.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "db.h"
+#include "defaults.h"
+#include "y.tab.h"
+
+/* Resident configuration daemon, '--serve socket'. The database is kept in
+ * memory and requests are answered on a Unix socket, one per line:
+ *
+ *   get SYMBOL           'ok <value>', or 'ok none' if it is not visible
+ *   eval EXPRESSION      'ok true' or 'ok false'
+ *   set SYMBOL=value     'ok'; as '--set', propagated at once
+ *   regenerate           'ok'; writes '.old.config', the autoconfig and
+ *                        the stamps of '--stamps'
+ *
+ * Errors are answered with 'err <message>'. Strings are quoted as in the
+ * autoconfig header.
+ *
+ * Readers work on an immutable snapshot: a database loaded and evaluated
+ * once, then never changed. 'set' forks the current snapshot, i.e. a view of
+ * its tree with its values, see 'share_db', applies the assignment to the
+ * view only and swaps it in; The lock is held only to take a reference. A
+ * snapshot is released once the last reader drops it, and the snapshot of
+ * its tree once the last view does. Input files are polled and snapshots are
+ * built from the binary cache, '.old.config' and pending 'set' values again
+ * if any changes. */
+
+#define POLL_INTERVAL 1         /* ... in seconds. */
+
+struct snapshot {
+    struct db db;
+    unsigned long refcount;
+
+    struct snapshot *tree;      /* ... of a forked snapshot, held by it. */
+
+    /* ... printed once, by the first 'regenerate'. */
+
+    char *config, *header;
+    size_t config_size, header_size;
+
+    unsigned long long key;     /* ... of input files, see 'input_key'. */
+};
+
+struct server {
+    const char *in_file, *out_file, *stamps_dir;
+    int nr_jobs;
+
+    pthread_mutex_t lock;       /* ... of 'current' and 'refcount'. */
+    struct snapshot *current;
+
+    /* Updates are serialised; Values of 'set' are pending until they are
+     * written to '.old.config' with 'regenerate'. */
+
+    pthread_mutex_t update_lock;
+    char **sets;
+    unsigned int nr_sets;
+};
+
+static struct snapshot *hold_snapshot(struct server *server,
+    struct snapshot *snapshot)
+{
+    pthread_mutex_lock(&server->lock);
+    snapshot->refcount++;
+    pthread_mutex_unlock(&server->lock);
+
+    return snapshot;
+}
+
+static struct snapshot *get_snapshot(struct server *server)
+{
+    struct snapshot *snapshot;
+
+    pthread_mutex_lock(&server->lock);
+    snapshot = server->current;
+    snapshot->refcount++;
+    pthread_mutex_unlock(&server->lock);
+
+    return snapshot;
+}
+
+static void put_snapshot(struct server *server, struct snapshot *snapshot)
+{
+    unsigned long refcount;
+
+    pthread_mutex_lock(&server->lock);
+    refcount = --snapshot->refcount;
+    pthread_mutex_unlock(&server->lock);
+
+    if (refcount > 0)
+        return;
+
+    release_db(&snapshot->db);
+    free(snapshot->config);
+    free(snapshot->header);
+
+    /* ... the tree is released after the view. */
+    if (snapshot->tree != NULL)
+        put_snapshot(server, snapshot->tree);
+
+    free(snapshot);
+}
+
+static void publish_snapshot(struct server *server, struct snapshot *snapshot)
+{
+    struct snapshot *old;
+
+    pthread_mutex_lock(&server->lock);
+    old = server->current;
+    server->current = snapshot;
+    pthread_mutex_unlock(&server->lock);
+
+    if (old != NULL)
+        put_snapshot(server, old);
+}
+
+static void stat_key(unsigned long long *key, const char *file)
+{
+    struct stat st;
+
+    memset(&st, 0, sizeof(st));
+    stat(file, &st);
+
+    *key = (*key ^ cache_hash(&st.st_mtim, sizeof(st.st_mtim))) * 31;
+    *key = (*key ^ cache_hash(&st.st_size, sizeof(st.st_size))) * 31;
+}
+
+/* Key of the input files of 'db', i.e. the main configuration file, the
+ * included files and '.old.config'; Changes if any of them changes. */
+static unsigned long long input_key(struct server *server, struct db *db)
+{
+    unsigned long long key = 0;
+    struct include *file;
+
+    stat_key(&key, server->in_file);
+    stat_key(&key, ".old.config");
+
+    LIST_FOREACH(file, &db->tree->files, node) {
+        stat_key(&key, file->file);
+    }
+
+    return key;
+}
+
+static int load_snapshot(struct server *server, struct snapshot *snapshot)
+{
+    struct db *db = &snapshot->db;
+    unsigned int i;
+
+    if (load_cache(db, _CACHE_FILE, server->in_file) == -1) {
+        if ((yy_parse_file(db, server->in_file) != 0) ||
+            (parse_includes(db, server->nr_jobs) == -1) ||
+            (link_db(db) == -1))
+            return -1;
+
+        if (save_cache(db, _CACHE_FILE, server->in_file) == -1)
+            perror("Writing '" _CACHE_FILE "'");
+    }
+
+    if (load_config_file(db, ".old.config") == -1) {
+        perror("Opening '.old.config'");
+        return -1;
+    }
+
+    for (i = 0; i < server->nr_sets; i++) {
+        if (set_config(db, server->sets[i]) == -1)
+            return -1;
+    }
+
+    apply_config(db);
+
+    /* ... every expression readers need is evaluated here, once. */
+    eval_db(db);
+
+    return SUCCESS;
+}
+
+/* Build a snapshot of the input files and pending values; 'key' is of the
+ * input files before they are read, or 0 to read it after. */
+static struct snapshot *build_snapshot(struct server *server,
+    unsigned long long key)
+{
+    struct snapshot *snapshot;
+
+    if ((snapshot = calloc(1, sizeof(struct snapshot))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        return NULL;
+    }
+
+    init_db(&snapshot->db);
+    snapshot->refcount = 1;
+
+    if (load_snapshot(server, snapshot) == -1) {
+        release_db(&snapshot->db);
+        free(snapshot->config);
+        free(snapshot->header);
+        free(snapshot);
+        return NULL;
+    }
+
+    snapshot->key = (key != 0) ? key : input_key(server, &snapshot->db);
+
+    return snapshot;
+}
+
+/* Fork 'current' with 'assignment' applied; 'errno' is set on errors, see
+ * 'update_config'. */
+static struct snapshot *fork_snapshot(struct server *server,
+    struct snapshot *current, const char *assignment)
+{
+    struct snapshot *snapshot;
+    int err;
+
+    if ((snapshot = calloc(1, sizeof(struct snapshot))) == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    snapshot->refcount = 1;
+    snapshot->key = current->key;   /* ... inputs are the same. */
+    snapshot->tree = hold_snapshot(server, (current->tree != NULL) ?
+            current->tree : current);
+
+    if (share_db(&snapshot->db, &current->db) == -1) {
+        errno = ENOMEM;
+        goto failed;
+    }
+
+    if (update_config(&snapshot->db, assignment) == -1)
+        goto failed;
+
+    eval_db(&snapshot->db);
+
+    return snapshot;
+
+failed:
+    err = errno;
+    put_snapshot(server, snapshot);
+    errno = err;
+
+    return NULL;
+}
+
+/* Print '.old.config' and the autoconfig of 'snapshot' once; Called with
+ * 'update_lock' held, readers do not use them. */
+static int print_snapshot(struct snapshot *snapshot)
+{
+    FILE *fp;
+
+    if (snapshot->config == NULL) {
+        if ((fp = open_memstream(&snapshot->config,
+                    &snapshot->config_size)) == NULL)
+            return -1;
+
+        fprintf_config_file(&snapshot->db, fp,
+            TK_LIST_EF_CONFIG | TK_LIST_EF_SELECTED);
+        fclose(fp);
+    }
+
+    if (snapshot->header == NULL) {
+        if ((fp = open_memstream(&snapshot->header,
+                    &snapshot->header_size)) == NULL)
+            return -1;
+
+        fprintf_autoconfig(&snapshot->db, fp);
+        fclose(fp);
+    }
+
+    return SUCCESS;
+}
+
+static void print_value(struct db *db, FILE *fp, item_t *item)
+{
+    token_t value = {
+        .ttype = TT_INVALID
+    };
+
+    /* ... snapshots are evaluated, and read by many clients at once. */
+    if (item_is_visible(db, item))
+        value = item_get_token(db, item);
+
+    switch (value.ttype) {
+    case TT_BOOL:
+        fprintf(fp, "ok %s\n", value.TK_BOOL ? "true" : "false");
+        break;
+
+    case TT_INTEGER:
+        fprintf(fp, "ok %d\n", value.TK_INTEGER);
+        break;
+
+    case TT_DESCRIPTION:
+        fprintf(fp, "ok \"%s\"\n", value.TK_STRING);
+        break;
+
+    default:                   /* ... not visible. */
+        fprintf(fp, "ok none\n");
+    }
+}
+
+static void do_get(struct server *server, FILE *fp, char *arg)
+{
+    struct snapshot *snapshot = get_snapshot(server);
+    item_t *item;
+
+    if ((item = hash_get_item(&snapshot->db, sym_lookup(&snapshot->db.symtab,
+                    arg, strlen(arg)))) == NULL)
+        fprintf(fp, "err undefined symbol: %s\n", arg);
+    else
+        print_value(&snapshot->db, fp, item);
+
+    put_snapshot(server, snapshot);
+}
+
+static void do_eval(struct server *server, FILE *fp, char *arg)
+{
+    struct snapshot *snapshot = get_snapshot(server);
+    bool value;
+
+    if (eval_string(&snapshot->db, arg, &value) == -1)
+        fprintf(fp, "err invalid expression\n");
+    else
+        fprintf(fp, "ok %s\n", value ? "true" : "false");
+
+    put_snapshot(server, snapshot);
+}
+
+static void do_set(struct server *server, FILE *fp, char *arg)
+{
+    struct snapshot *current, *snapshot = NULL;
+    char **sets, *set;
+
+    pthread_mutex_lock(&server->update_lock);
+    current = get_snapshot(server);
+
+    if (((set = strdup(arg)) == NULL) ||
+        ((sets = realloc(server->sets,
+                    (server->nr_sets + 1) * sizeof(char *))) == NULL)) {
+        free(set);
+        fprintf(fp, "err out of memory\n");
+        goto out;
+    }
+
+    server->sets = sets;
+
+    if ((snapshot = fork_snapshot(server, current, arg)) == NULL) {
+        free(set);
+
+        if (errno == ENOENT)
+            fprintf(fp, "err undefined symbol: %.*s\n",
+                (int)strcspn(arg, "="), arg);
+        else if (errno == ERANGE)
+            fprintf(fp, "err invalid value: %s\n", arg);
+        else if (errno == EINVAL)
+            fprintf(fp, "err invalid assignment: %s\n", arg);
+        else
+            fprintf(fp, "err %s\n", strerror(errno));
+
+        goto out;
+    }
+
+    /* ... pending for snapshots built again, see 'watcher'. */
+    sets[server->nr_sets++] = set;
+
+    publish_snapshot(server, snapshot);
+    fprintf(fp, "ok\n");
+
+out:
+    put_snapshot(server, current);
+    pthread_mutex_unlock(&server->update_lock);
+}
+
+static void do_regenerate(struct server *server, FILE *fp)
+{
+    struct snapshot *snapshot;
+    unsigned int i;
+
+    pthread_mutex_lock(&server->update_lock);
+    snapshot = get_snapshot(server);
+
+    if ((print_snapshot(snapshot) == -1) ||
+        (update_file(".old.config", snapshot->config, snapshot->config_size,
+                CONFIG_FILE_MODE, false) == -1) ||
+        (update_file(server->out_file, snapshot->header,
+                snapshot->header_size, AUTOCONFIG_MODE, false) == -1) ||
+        ((server->stamps_dir != NULL) &&
+            (update_stamps(&snapshot->db, server->stamps_dir) == -1))) {
+        fprintf(fp, "err %s\n", strerror(errno));
+
+    } else {
+        /* ... pending values are in '.old.config' now. */
+        for (i = 0; i < server->nr_sets; i++)
+            free(server->sets[i]);
+
+        server->nr_sets = 0;
+        fprintf(fp, "ok\n");
+    }
+
+    put_snapshot(server, snapshot);
+    pthread_mutex_unlock(&server->update_lock);
+}
+
+static void do_request(struct server *server, FILE *fp, char *line)
+{
+    char *arg;
+
+    if ((arg = strchr(line, ' ')) != NULL)
+        *arg++ = '\0';
+    else
+        arg = line + strlen(line);
+
+    if (strcmp(line, "get") == 0)
+        do_get(server, fp, arg);
+
+    else if (strcmp(line, "eval") == 0)
+        do_eval(server, fp, arg);
+
+    else if (strcmp(line, "set") == 0)
+        do_set(server, fp, arg);
+
+    else if (strcmp(line, "regenerate") == 0)
+        do_regenerate(server, fp);
+
+    else
+        fprintf(fp, "err unknown request: %s\n", line);
+}
+
+struct client {
+    struct server *server;
+    int fd;
+};
+
+static void *client(void *arg)
+{
+    struct client *c = arg;
+    FILE *in, *out = NULL;
+    char *line = NULL;
+    size_t n = 0;
+    ssize_t len;
+
+    if (((in = fdopen(c->fd, "r")) == NULL) ||
+        ((out = fdopen(dup(c->fd), "w")) == NULL))
+        goto out;
+
+    while ((len = getline(&line, &n, in)) != -1) {
+        if ((len > 0) && (line[len - 1] == '\n'))
+            line[--len] = '\0';
+
+        if (len == 0)
+            continue;
+
+        do_request(c->server, out, line);
+
+        if (fflush(out) == EOF)
+            break;
+    }
+
+out:
+    if (out != NULL)
+        fclose(out);
+
+    if (in != NULL)
+        fclose(in);
+    else
+        close(c->fd);
+
+    free(line);
+    free(c);
+
+    return NULL;
+}
+
+/* Poll input files, rebuild the snapshot if any of them changes. A failed
+ * build, e.g. of a file being edited, is retried once files change again. */
+static void *watcher(void *arg)
+{
+    struct server *server = arg;
+    struct snapshot *snapshot;
+    unsigned long long key, last = 0;
+
+    while (1) {
+        sleep(POLL_INTERVAL);
+
+        snapshot = get_snapshot(server);
+        key = input_key(server, &snapshot->db);
+
+        if (last == 0)
+            last = snapshot->key;
+
+        put_snapshot(server, snapshot);
+
+        if (key == last)
+            continue;
+
+        last = key;
+
+        pthread_mutex_lock(&server->update_lock);
+
+        if ((snapshot = build_snapshot(server, key)) != NULL) {
+            publish_snapshot(server, snapshot);
+            printf("... reloaded\n");
+        } else
+            error_print("reloading failed, keeping the last snapshot.\n");
+
+        pthread_mutex_unlock(&server->update_lock);
+        fflush(stdout);
+    }
+
+    return NULL;
+}
+
+int serve_config(const char *socket_file, const char *in_file,
+    const char *out_file, const char *stamps_dir, int nr_jobs)
+{
+    struct server server = {
+        .out_file = out_file,
+        .stamps_dir = stamps_dir,
+        .nr_jobs = nr_jobs,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .update_lock = PTHREAD_MUTEX_INITIALIZER,
+    };
+
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX
+    };
+
+    struct snapshot *snapshot;
+    struct client *c;
+    char *in_dirname, *in_basename;
+    pthread_t thread;
+    int fd;
+
+    if (strlen(socket_file) >= sizeof(addr.sun_path)) {
+        error_print("socket path is too long.\n");
+        return -1;
+    }
+
+    strcpy(addr.sun_path, socket_file);
+
+    /* ... before changing CWD, 'socket_file' is relative to it. */
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+        return -1;
+
+    unlink(socket_file);
+
+    if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) ||
+        (listen(fd, SOMAXCONN) == -1)) {
+        close(fd);
+        return -1;
+    }
+
+    /* ... included files are relative to the main configuration file. */
+    in_dirname = strdup(in_file);
+    in_basename = strdup(in_file);
+    server.in_file = basename(in_basename);
+
+    if (chdir(dirname(in_dirname)) == -1)
+        return -1;
+
+    if ((snapshot = build_snapshot(&server, 0)) == NULL)
+        return -1;
+
+    publish_snapshot(&server, snapshot);
+
+    /* ... a client may go away before it reads its answer. */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (pthread_create(&thread, NULL, watcher, &server) != 0)
+        return -1;
+
+    pthread_detach(thread);
+
+    printf("... serving on %s\n", socket_file);
+    fflush(stdout);
+
+    while (1) {
+        if ((c = malloc(sizeof(struct client))) == NULL)
+            return -1;
+
+        c->server = &server;
+
+        if ((c->fd = accept(fd, NULL, NULL)) == -1) {
+            free(c);
+
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        if (pthread_create(&thread, NULL, client, c) != 0) {
+            close(c->fd);
+            free(c);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+
+    return SUCCESS;
+}
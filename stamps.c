@@ -0,0 +1,153 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "db.h"
+#include "defaults.h"
+
+/* Per-symbol stamps, as 'include/config/' in Linux: The stamps directory has
+ * an empty file for every symbol, touched only if the value of the symbol in
+ * the autoconfig header changes. 'fixdep' makes objects depend on the stamps
+ * of the symbols they use, rather than the header.
+ *
+ * Values of the last run are kept in 'auto.conf' in the stamps directory, in
+ * the same format as the header. */
+
+#define AUTO_CONF "auto.conf"
+
+struct span {
+    const char *start;
+    size_t len;
+};
+
+static int touch(const char *dir, const char *name)
+{
+    char *path = alloca(strlen(dir) + strlen(name) + 2);
+    int fd;
+
+    sprintf(path, "%s/%s", dir, name);
+
+    if ((fd = open(path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP |
+                S_IWGRP | S_IROTH | S_IWOTH)) == -1)
+        return -1;
+
+    futimens(fd, NULL);
+    close(fd);
+
+    return SUCCESS;
+}
+
+/* Split 'data' to '#define SYMBOL value' lines; Lines of a symbol follow each
+ * other, so the value of a symbol is the span of its lines. 'unknown' is
+ * called for the symbols not in 'db'. */
+static void parse_autoconf(struct db *db, const char *data, size_t size,
+    struct span *spans, const char *dir, bool unknown)
+{
+    const char *p = data, *end = data + size, *eol, *sym;
+    symbol_t id;
+
+    for (; p < end; p = eol + 1) {
+        if ((eol = memchr(p, '\n', end - p)) == NULL)
+            eol = end;
+
+        if ((eol - p < 8) || (strncmp(p, "#define ", 8) != 0))
+            continue;
+
+        sym = p + 8;
+        for (p = sym; (p < eol) && (*p != ' '); p++) ;
+
+        if ((id = sym_lookup(&db->symtab, sym, p - sym)) == SYM_INVALID ||
+            (hash_get_item(db, id) == NULL)) {
+
+            /* ... the symbol is removed from the configuration. */
+            if (unknown) {
+                char *name = strndup(sym, p - sym);
+
+                if (name != NULL) {
+                    touch(dir, name);
+                    free(name);
+                }
+            }
+
+            continue;
+        }
+
+        if (spans[id].start == NULL)
+            spans[id].start = sym - 8;
+
+        spans[id].len = (eol - spans[id].start);
+    }
+}
+
+int update_stamps(struct db *db, const char *dir)
+{
+    struct span *old_spans, *new_spans;
+    item_t *item;
+    FILE *fp;
+    char *data, *path, *old = MAP_FAILED;
+    size_t size, old_size = 0;
+    bool all = true;
+    int fd, ret = -1;
+
+    if ((mkdir(dir, S_IRWXU | S_IRWXG | S_IRWXO) == -1) && (errno != EEXIST))
+        return -1;
+
+    if ((fp = open_memstream(&data, &size)) == NULL)
+        return -1;
+
+    fprintf_menu(db, fp, &db->tree->main_menu);
+    fclose(fp);
+
+    old_spans = calloc(nr_symbols(&db->symtab) + 1, sizeof(struct span));
+    new_spans = calloc(nr_symbols(&db->symtab) + 1, sizeof(struct span));
+
+    if ((old_spans == NULL) || (new_spans == NULL))
+        goto out;
+
+    path = alloca(strlen(dir) + sizeof(AUTO_CONF) + 1);
+    sprintf(path, "%s/" AUTO_CONF, dir);
+
+    /* Without the values of the last run, every stamp is touched. */
+
+    if ((fd = open(path, O_RDONLY)) != -1) {
+        struct stat st;
+
+        if ((fstat(fd, &st) == 0) && ((old_size = st.st_size) > 0))
+            old = mmap(NULL, old_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        all = (old_size > 0) && (old == MAP_FAILED);
+        close(fd);
+    }
+
+    if (old != MAP_FAILED)
+        parse_autoconf(db, old, old_size, old_spans, dir, true);
+
+    parse_autoconf(db, data, size, new_spans, dir, false);
+
+    LIST_FOREACH(item, &db->tree->symtable, sym_node) {
+        struct span *o = &old_spans[item->id], *n = &new_spans[item->id];
+
+        if (all || (o->len != n->len) ||
+            ((n->len > 0) && (memcmp(o->start, n->start, n->len) != 0))) {
+            if (touch(dir, item->common.symbol) == -1)
+                goto out;
+        }
+    }
+
+    ret = update_file(path, data, size, S_IRUSR | S_IWUSR | S_IRGRP |
+            S_IWGRP | S_IROTH | S_IWOTH, false);
+
+out:
+    if (old != MAP_FAILED)
+        munmap(old, old_size);
+
+    free(old_spans);
+    free(new_spans);
+    free(data);
+
+    return ret;
+}
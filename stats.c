@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "defaults.h"
+
+bool stats_enabled = false;
+unsigned long stats_counters[NR_STATS];
+
+static const char *counter_names[NR_STATS] = {
+    [STAT_EVAL_EXPR] = "eval_expr calls",
+    [STAT_EVAL_ITEM] = "items evaluated",
+    [STAT_SYM_LOOKUP] = "symbol lookups",
+    [STAT_SYM_PROBE] = "symbol slots probed",
+    [STAT_ITEM_LOOKUP] = "hash_get_item calls",
+    [STAT_ITEM_MISS] = "hash_get_item misses",
+    [STAT_SELECT] = "select propagations",
+    [STAT_ALLOC] = "allocations",
+    [STAT_ALLOC_BYTES] = "allocated bytes",
+    [STAT_CHUNK] = "arena chunks",
+    [STAT_CHUNK_BYTES] = "arena chunk bytes",
+    [STAT_VALUE_COPY] = "value pages copied",
+};
+
+struct phase {
+    char *name, *arg;
+    double wall_ms, cpu_ms;
+};
+
+/* Phases are recorded on the main thread, in order. */
+static struct phase *phases;
+static unsigned int nr_phases, max_phases;
+
+static double ms(const struct timespec *t0, const struct timespec *t1)
+{
+    return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+void stats_start(struct timer *timer, bool thread)
+{
+    timer->thread = thread;
+
+    clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+    clock_gettime(thread ? CLOCK_THREAD_CPUTIME_ID :
+        CLOCK_PROCESS_CPUTIME_ID, &timer->cpu);
+}
+
+void stats_stop(struct timer *timer)
+{
+    struct timespec wall, cpu;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(timer->thread ? CLOCK_THREAD_CPUTIME_ID :
+        CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+    timer->wall_ms = ms(&timer->wall, &wall);
+    timer->cpu_ms = ms(&timer->cpu, &cpu);
+}
+
+/* Record a phase timed with 'timer'; The timer is stopped if it is not. */
+void stats_phase(const char *name, const char *arg, struct timer *timer)
+{
+    struct phase *phase;
+
+    if (!stats_enabled)
+        return;
+
+    if (!timer->thread)
+        stats_stop(timer);
+
+    if (nr_phases == max_phases) {
+        unsigned int n = (max_phases == 0) ? 64 : 2 * max_phases;
+
+        if ((phase = realloc(phases, n * sizeof(struct phase))) == NULL) {
+            error_print("''alloc'' failed.\n");
+            return;
+        }
+
+        phases = phase;
+        max_phases = n;
+    }
+
+    phase = &phases[nr_phases++];
+    phase->name = strdup(name);
+    phase->arg = (arg != NULL) ? strdup(arg) : NULL;
+    phase->wall_ms = timer->wall_ms;
+    phase->cpu_ms = timer->cpu_ms;
+}
+
+void print_stats(FILE *fp)
+{
+    unsigned int i;
+
+    if (!stats_enabled)
+        return;
+
+    fprintf(fp, "\n%-12s %-36s %12s %12s\n", "phase", "", "wall ms", "cpu ms");
+
+    for (i = 0; i < nr_phases; i++) {
+        fprintf(fp, "%-12s %-36s %12.3f %12.3f\n", phases[i].name,
+            (phases[i].arg != NULL) ? phases[i].arg : "", phases[i].wall_ms,
+            phases[i].cpu_ms);
+
+        free(phases[i].name);
+        free(phases[i].arg);
+    }
+
+    fprintf(fp, "\n%-49s %12s\n", "counter", "");
+
+    for (i = 0; i < NR_STATS; i++)
+        fprintf(fp, "%-49s %12lu\n", counter_names[i], stats_counters[i]);
+
+    free(phases);
+    phases = NULL;
+    nr_phases = max_phases = 0;
+}
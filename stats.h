@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+/* Phase timing and counters of hot paths, enabled with '--stats'. Counters
+ * are updated on parser threads as well, so they are atomic; A disabled
+ * counter costs a predicted branch. */
+
+enum stat_counter {
+    STAT_EVAL_EXPR,             /* 'eval_expr' calls. */
+    STAT_EVAL_ITEM,             /* Items evaluated. */
+    STAT_SYM_LOOKUP,            /* Symbol table lookups ... */
+    STAT_SYM_PROBE,             /* ... and slots probed. */
+    STAT_ITEM_LOOKUP,           /* 'hash_get_item' calls ... */
+    STAT_ITEM_MISS,             /* ... without an item. */
+    STAT_SELECT,                /* Selects followed. */
+    STAT_ALLOC,                 /* Arena allocations ... */
+    STAT_ALLOC_BYTES,           /* ... and their bytes. */
+    STAT_CHUNK,                 /* Arena chunks ... */
+    STAT_CHUNK_BYTES,           /* ... and their bytes. */
+    STAT_VALUE_COPY,            /* Value pages copied on write. */
+    NR_STATS
+};
+
+extern bool stats_enabled;
+extern unsigned long stats_counters[NR_STATS];
+
+#define stat_add(_c, _n) do { \
+        if (__builtin_expect(stats_enabled, 0)) \
+            __atomic_fetch_add(&stats_counters[(_c)], (_n), \
+                __ATOMIC_RELAXED); \
+    } while (0)
+
+#define stat_inc(_c) stat_add((_c), 1)
+
+/* Wall and CPU time of a phase; CPU time is of the calling thread or of the
+ * whole process. */
+
+struct timer {
+    bool thread;
+    struct timespec wall, cpu;
+    double wall_ms, cpu_ms;     /* ... set with 'stats_stop'. */
+};
+
+extern void stats_start(struct timer *, bool);
+extern void stats_stop(struct timer *);
+extern void stats_phase(const char *, const char *, struct timer *);
+extern void print_stats(FILE *);
+
+#endif /* __STATS_H__ */
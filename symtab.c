@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symtab.h"
+#include "defaults.h"
+
+#define SYMTAB_MIN_SLOTS 256
+
+static unsigned int sym_hash(const char *name, size_t len)
+{
+    unsigned int hash = 2166136261U;    /* FNV-1a. */
+
+    while (len-- > 0) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static symbol_t *sym_slot(struct symtab *symtab, const char *name, size_t len,
+    unsigned int hash)
+{
+    unsigned int i = hash & symtab->mask, n = 1;
+
+    while (symtab->slots[i] != SYM_INVALID) {
+        struct symbol *sym = sym_get(symtab, symtab->slots[i]);
+
+        if ((sym->hash == hash) &&
+            (strncmp(sym->name, name, len) == 0) && (sym->name[len] == '\0'))
+            break;
+
+        i = (i + 1) & symtab->mask;
+        n++;
+    }
+
+    stat_inc(STAT_SYM_LOOKUP);
+    stat_add(STAT_SYM_PROBE, n);
+
+    return &symtab->slots[i];
+}
+
+static int sym_rehash(struct symtab *symtab, unsigned int nr_slots)
+{
+    symbol_t id, *slots = malloc(nr_slots * sizeof(symbol_t));
+
+    if (slots == NULL)
+        return -1;
+
+    memset(slots, 0xff, nr_slots * sizeof(symbol_t));     /* ... SYM_INVALID. */
+
+    free(symtab->slots);
+    symtab->slots = slots;
+    symtab->mask = nr_slots - 1;
+
+    for (id = 0; id < symtab->nr_symbols; id++) {
+        unsigned int i = sym_get(symtab, id)->hash & symtab->mask;
+
+        while (symtab->slots[i] != SYM_INVALID)
+            i = (i + 1) & symtab->mask;
+
+        symtab->slots[i] = id;
+    }
+
+    return 0;
+}
+
+symbol_t sym_lookup(struct symtab *symtab, const char *name, size_t len)
+{
+    if (symtab->slots == NULL)
+        return SYM_INVALID;
+
+    return *sym_slot(symtab, name, len, sym_hash(name, len));
+}
+
+symbol_t sym_intern(struct symtab *symtab, const char *name, size_t len)
+{
+    symbol_t *slot;
+    struct symbol *sym;
+    unsigned int hash = sym_hash(name, len);
+
+    /* Keep the table at most half full, so probe sequences stay short. */
+    if (2 * (symtab->nr_symbols + 1) > symtab->mask + 1) {
+        if (sym_rehash(symtab, (symtab->slots == NULL) ?
+                SYMTAB_MIN_SLOTS : 2 * (symtab->mask + 1)) == -1) {
+            error_print("''symtab'' rehash failed.\n");
+            return SYM_INVALID;
+        }
+    }
+
+    if (*(slot = sym_slot(symtab, name, len, hash)) != SYM_INVALID)
+        return *slot;
+
+    if (symtab->nr_symbols == symtab->max_symbols) {
+        unsigned int n = (symtab->max_symbols == 0) ?
+            SYMTAB_MIN_SLOTS : 2 * symtab->max_symbols;
+        struct symbol *symbols = realloc(symtab->symbols,
+                n * sizeof(struct symbol));
+
+        if (symbols == NULL) {
+            error_print("''alloc'' failed.\n");
+            return SYM_INVALID;
+        }
+
+        symtab->symbols = symbols;
+        symtab->max_symbols = n;
+    }
+
+    sym = &symtab->symbols[symtab->nr_symbols];
+
+    if ((sym->name = arena_strndup(&symtab->names, name, len)) == NULL) {
+        error_print("''alloc'' failed.\n");
+        return SYM_INVALID;
+    }
+
+    sym->hash = hash;
+    sym->item = NULL;
+
+    return (*slot = symtab->nr_symbols++);
+}
+
+void sym_release(struct symtab *symtab)
+{
+    free(symtab->symbols);
+    free(symtab->slots);
+    arena_release(&symtab->names);
+
+    *symtab = (struct symtab) SYMTAB_INIT;
+}
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef __SYMTAB_H__
+#define __SYMTAB_H__
+
+#include <stddef.h>
+
+#include "arena.h"
+
+/* Every symbol is interned once, at lex time, and is referred by its dense
+ * 'symbol_t' index afterwards. */
+
+typedef unsigned int symbol_t;
+#define SYM_INVALID ((symbol_t) ~0U)
+
+struct item;
+
+struct symbol {
+    char *name;
+    unsigned int hash;
+    struct item *item;          /* The item defines this symbol, if any. */
+};
+
+struct symtab {
+    struct symbol *symbols;     /* Indexed by 'symbol_t'. */
+    unsigned int nr_symbols, max_symbols;
+
+    /* Open-addressing (linear probing) index into 'symbols'. Number of slots
+     * is power of two and the table is kept at most half full. */
+
+    symbol_t *slots;
+    unsigned int mask;
+
+    struct arena names;
+};
+
+#define SYMTAB_INIT { NULL, 0, 0, NULL, 0, ARENA_INIT }
+
+extern symbol_t sym_intern(struct symtab *, const char *, size_t);
+extern symbol_t sym_lookup(struct symtab *, const char *, size_t);
+extern void sym_release(struct symtab *);
+
+static inline struct symbol *sym_get(struct symtab *symtab, symbol_t id)
+{
+    return &symtab->symbols[id];
+}
+
+#define sym_name(_s, _id) (sym_get((_s), (_id))->name)
+#define nr_symbols(_s) ((_s)->nr_symbols)
+
+#endif /* __SYMTAB_H__ */
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "defaults.h"
+
+#ifdef TRACE
+
+/* Spans are 'B' and 'E' events of the calling thread; Threads are numbered
+ * as they write their first event, the main thread is 1. Others are parsers
+ * or workers of '--batch' and '--randconfig', all named "worker". */
+
+static FILE *trace_fp;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec trace_start;
+static unsigned int nr_tids;
+static __thread unsigned int tid;
+
+static double trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec - trace_start.tv_sec) * 1e6 +
+        (ts.tv_nsec - trace_start.tv_nsec) / 1e3;
+}
+
+static void print_string(const char *s)
+{
+    fputc('"', trace_fp);
+
+    for (; *s != '\0'; s++) {
+        if ((*s == '"') || (*s == '\\'))
+            fprintf(trace_fp, "\\%c", *s);
+        else if ((unsigned char)*s < ' ')
+            fprintf(trace_fp, "\\u%04x", *s);
+        else
+            fputc(*s, trace_fp);
+    }
+
+    fputc('"', trace_fp);
+}
+
+/* Name the thread of the caller on its first event; Lock is held. */
+static void trace_thread(void)
+{
+    if (tid != 0)
+        return;
+
+    tid = ++nr_tids;
+    fprintf(trace_fp, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+        "\"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s %u\"}}", tid,
+        (tid == 1) ? "main" : "worker", tid);
+}
+
+int trace_open(const char *filename)
+{
+    if ((trace_fp = fopen(filename, "w")) == NULL)
+        return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &trace_start);
+    fprintf(trace_fp, "[\n{\"name\": \"process_name\", \"ph\": \"M\", "
+        "\"pid\": 1, \"args\": {\"name\": \"config.ncurses\"}}");
+
+    pthread_mutex_lock(&trace_lock);
+    trace_thread();
+    pthread_mutex_unlock(&trace_lock);
+
+    /* ... the file is complete on early exits, as well. */
+    atexit(trace_close);
+
+    return 0;
+}
+
+void trace_close(void)
+{
+    if (trace_fp == NULL)
+        return;
+
+    fprintf(trace_fp, "\n]\n");
+    fclose(trace_fp);
+    trace_fp = NULL;
+}
+
+void trace_begin(const char *name, const char *arg)
+{
+    if (trace_fp == NULL)
+        return;
+
+    pthread_mutex_lock(&trace_lock);
+    trace_thread();
+
+    fprintf(trace_fp, ",\n{\"name\": \"%s\", \"ph\": \"B\", \"ts\": %.3f, "
+        "\"pid\": 1, \"tid\": %u", name, trace_now(), tid);
+
+    if (arg != NULL) {
+        fprintf(trace_fp, ", \"args\": {\"arg\": ");
+        print_string(arg);
+        fprintf(trace_fp, "}");
+    }
+
+    fprintf(trace_fp, "}");
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_end(void)
+{
+    if (trace_fp == NULL)
+        return;
+
+    pthread_mutex_lock(&trace_lock);
+    fprintf(trace_fp, ",\n{\"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, "
+        "\"tid\": %u}", trace_now(), tid);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+#endif /* TRACE */
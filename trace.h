@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/* Trace events in Chrome's JSON format, for Perfetto or 'chrome://tracing',
+ * written with '--trace file'. Tracing is built in with '-DTRACE' only; The
+ * spans are empty otherwise, so they cost nothing. */
+
+#include <errno.h>
+
+#include "defaults.h"
+
+#ifdef TRACE
+extern int trace_open(const char *);
+extern void trace_close(void);
+extern void trace_begin(const char *, const char *);
+extern void trace_end(void);
+#else
+#define trace_open(_file) ({ \
+        error_print("built without 'TRACE'.\n"); \
+        errno = ENOSYS; \
+        -1; \
+    })
+
+#define trace_close()
+#define trace_begin(_name, _arg)
+#define trace_end()
+#endif
+
+#endif /* __TRACE_H__ */
@@ -0,0 +1,266 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include "db.h"
+#include "defaults.h"
+#include "y.tab.h"
+
+/* Every 'struct values' holds a reference to each of its pages; A page shared
+ * with another 'struct values' is copied before it is written, see
+ * 'value_write'. References are atomic, so a snapshot can be passed to other
+ * threads, but a 'struct values' is used on one thread at a time.
+ *
+ * Strings of values are interned in 'db->strings' and values hold their
+ * index, so snapshots must not outlive the database. */
+
+static void put_page(struct value_page *page)
+{
+    if (__atomic_sub_fetch(&page->users, 1, __ATOMIC_ACQ_REL) == 0)
+        free(page);
+}
+
+struct value_page *__value_write(struct values *values, symbol_t id)
+{
+    struct value_page **page = &values->pages[id >> VALUES_PAGE_SHIFT];
+    struct value_page *copy;
+
+    /* ... writes do not fail, callers can not undo a half done change. */
+    if ((copy = malloc(sizeof(struct value_page))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(copy, *page, sizeof(struct value_page));
+    copy->users = 1;
+
+    put_page(*page);
+    *page = copy;
+
+    stat_inc(STAT_VALUE_COPY);
+
+    return copy;
+}
+
+/* Index of 'str' in 'db->strings'; -1 if it can not be interned. */
+int intern_string(struct db *db, const char *str)
+{
+    symbol_t id = sym_intern(&db->strings, str, strlen(str));
+
+    return (id == SYM_INVALID) ? -1 : (int)id;
+}
+
+/* The value of 'item' as a token; 'TT_INVALID' for a choice without a
+ * selected option. */
+token_t item_get_token(struct db *db, item_t *item)
+{
+    struct extended_token *et;
+    token_t token = {
+        .ttype = TT_INVALID
+    };
+    int n = item_data(db, item);
+
+    if ((et = item_get_config_et(item)) == NULL)
+        return (n == NO_OPTION) ? token : item->options[n]->token;
+
+    token = et->token;          /* ... and the base of integers. */
+
+    if (token.ttype == TT_BOOL)
+        token.TK_BOOL = item_bool(db, item);
+    else if (token.ttype == TT_INTEGER)
+        token.TK_INTEGER = n;
+    else                        /* and TT_DESCRIPTION. */
+        token.TK_STRING = sym_name(&db->strings, n);
+
+    return token;
+}
+
+/* An option of a choice is selected if it has the value of the selected
+ * option; Options may share a value. */
+bool option_selected(struct db *db, item_t *item, struct extended_token *et)
+{
+    struct extended_token *selected;
+    int n = item_data(db, item);
+
+    if (n == NO_OPTION)
+        return false;
+
+    if ((selected = item->options[n]) == et)
+        return true;
+
+    if (et->token.ttype == TT_INTEGER)
+        return et->token.TK_INTEGER == selected->token.TK_INTEGER;
+
+    return strcmp(et->token.TK_STRING, selected->token.TK_STRING) == 0;
+}
+
+/* Fill 'options' of choices; Arrays are NULL when counting. */
+static void __link_options(struct db *db)
+{
+    struct extended_token *et;
+    item_t *item;
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        if (item_get_config_et(item) != NULL)
+            continue;
+
+        item->nr_options = 0;
+
+        item_token_list_for_each_entry(et, item) {
+            if (item->options != NULL)
+                item->options[item->nr_options] = et;
+
+            item->nr_options++;
+        }
+    }
+}
+
+int link_options(struct db *db)
+{
+    struct extended_token **options;
+    item_t *item;
+    unsigned int n = 0;
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        item->options = NULL;
+        item->nr_options = 0;
+    }
+
+    /* First pass counts options with arrays set to NULL. */
+    __link_options(db);
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        n += item->nr_options;
+    }
+
+    if ((options = arena_alloc(&db->node_arena,
+                (n + 1) * sizeof(struct extended_token *))) == NULL) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        if (item->nr_options > 0) {
+            item->options = options;
+            options += item->nr_options;
+        }
+    }
+
+    __link_options(db);
+
+    return SUCCESS;
+}
+
+void release_values(struct values *values)
+{
+    unsigned int i;
+
+    for (i = 0; i < values->nr_pages; i++) {
+        if (values->pages[i] != NULL)
+            put_page(values->pages[i]);
+    }
+
+    free(values->pages);
+    *values = (struct values) VALUES_INIT;
+}
+
+/* Set the values of 'db' to defaults, i.e. the tokens of configuration
+ * options; No option of a choice is selected. */
+int init_values(struct db *db)
+{
+    struct values *values = &db->values;
+    struct extended_token *et;
+    item_t *item;
+    unsigned int i, n;
+    int data;
+
+    n = (nr_symbols(&db->symtab) + VALUES_PER_PAGE - 1) >> VALUES_PAGE_SHIFT;
+
+    release_values(values);
+
+    if ((values->pages = calloc(n + 1, sizeof(struct value_page *))) == NULL)
+        goto failed;
+
+    for (values->nr_pages = n, i = 0; i < n; i++) {
+        if ((values->pages[i] = calloc(1, sizeof(struct value_page))) == NULL)
+            goto failed;
+
+        values->pages[i]->users = 1;
+    }
+
+    LIST_FOREACH(item, &db->symtable, sym_node) {
+        data = NO_OPTION;
+
+        if ((et = item_get_config_et(item)) == NULL)
+            ;                   /* ... multiple choices. */
+
+        else if (et->token.ttype == TT_BOOL) {
+            item_set_bool(db, item, et->token.TK_BOOL);
+            item_set_own(db, item, et->token.TK_BOOL);
+
+        } else if (et->token.ttype == TT_INTEGER)
+            data = et->token.TK_INTEGER;
+
+        else if ((data = intern_string(db, et->token.TK_STRING)) == -1)
+            goto failed;
+
+        item_set_data(db, item, data);
+    }
+
+    /* ... nothing is evaluated, yet. */
+    for (i = 0; i < n; i++)
+        memset(values->pages[i]->changed, 0, sizeof(values->pages[i]->changed));
+
+    return SUCCESS;
+
+failed:
+    error_print("''alloc'' failed.\n");
+    release_values(values);
+
+    return -1;
+}
+
+/* Take a snapshot of the evaluated values of 'db'; 'db' and the snapshot
+ * share pages until either is changed. */
+int snapshot_values(struct db *db, struct values *snapshot)
+{
+    eval_db(db);
+
+    return share_values(snapshot, &db->values);
+}
+
+/* Share the pages of 'values' with 'copy'; 'values' is not written, so it
+ * can be shared by threads at the same time. */
+int share_values(struct values *copy, const struct values *values)
+{
+    unsigned int i, n = values->nr_pages;
+
+    if ((copy->pages = malloc((n + 1) * sizeof(struct value_page *))) ==
+        NULL) {
+        error_print("''alloc'' failed.\n");
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        copy->pages[i] = values->pages[i];
+        __atomic_add_fetch(&copy->pages[i]->users, 1, __ATOMIC_RELAXED);
+    }
+
+    copy->nr_pages = n;
+
+    return SUCCESS;
+}
+
+/* Replace the values of 'db' with a snapshot of them; The snapshot is kept,
+ * so it can be restored again. */
+void restore_values(struct db *db, const struct values *snapshot)
+{
+    unsigned int i;
+
+    for (i = 0; i < snapshot->nr_pages; i++) {
+        __atomic_add_fetch(&snapshot->pages[i]->users, 1, __ATOMIC_RELAXED);
+        put_page(db->values.pages[i]);
+        db->values.pages[i] = snapshot->pages[i];
+    }
+
+    /* ... values of the snapshot are evaluated, already. */
+    reset_eval(db);
+}
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef __VALUES_H__
+#define __VALUES_H__
+
+#include <stdint.h>
+
+#include "config.parser.h"
+
+/* Values of a configuration, apart from the configuration tree; The tree is
+ * not changed once it is linked: Values are here, and cached results of
+ * expressions and the evaluation queue are in 'struct db', see 'init_eval'.
+ *
+ * Values are indexed by 'symbol_t' and kept in pages. Pages are shared by
+ * snapshots of the values and copied on the first write, so a snapshot costs
+ * a copy of the page table.
+ *
+ * A page holds each kind of value in an array, i.e. bits of 'BOOL' values
+ * and of visibility are adjacent; Passes over the tree read a few cache
+ * lines per page rather than a token list per item. */
+
+#define VALUES_PAGE_SHIFT 7
+#define VALUES_PER_PAGE (1U << VALUES_PAGE_SHIFT)
+#define VALUES_PAGE_WORDS (VALUES_PER_PAGE / 64)
+
+#define NO_OPTION (-1)
+
+struct value_page {
+    unsigned long users;        /* ... number of 'struct values' sharing it. */
+
+    /* Values of 'BOOL' items and their own values, see 'select.c'. An item is
+     * 'visible' if its dependency holds; 'changed' is set once its value
+     * changes, until it is evaluated. See 'eval.c'. */
+
+    uint64_t bools[VALUES_PAGE_WORDS];
+    uint64_t own[VALUES_PAGE_WORDS];
+    uint64_t visible[VALUES_PAGE_WORDS];
+    uint64_t changed[VALUES_PAGE_WORDS];
+
+    /* Values of 'INTEGER' items, 'STRING' values as indexes in 'db->strings'
+     * and the selected options of choices as indexes in 'options' of items,
+     * 'NO_OPTION' if none; A symbol has one type. */
+
+    int data[VALUES_PER_PAGE];
+
+    /* Number of 'true' items selecting a 'BOOL' item. */
+    unsigned int refcount[VALUES_PER_PAGE];
+};
+
+struct values {
+    struct value_page **pages;
+    unsigned int nr_pages;
+};
+
+#define VALUES_INIT { NULL, 0 }
+
+#define value_slot(_id) ((_id) & (VALUES_PER_PAGE - 1))
+#define value_mask(_id) (1ULL << ((_id) & 63))
+
+static inline bool value_test(const uint64_t *bits, symbol_t id)
+{
+    return (bits[value_slot(id) >> 6] & value_mask(id)) != 0;
+}
+
+static inline void value_assign(uint64_t *bits, symbol_t id, bool set)
+{
+    if (set)
+        bits[value_slot(id) >> 6] |= value_mask(id);
+    else
+        bits[value_slot(id) >> 6] &= ~value_mask(id);
+}
+
+/* Bits of visible 'true' values of symbols '64 * word' to '64 * word + 63'. */
+static inline uint64_t value_word(const struct values *values,
+    unsigned int word)
+{
+    const struct value_page *page =
+        values->pages[word >> (VALUES_PAGE_SHIFT - 6)];
+    unsigned int i = word & (VALUES_PAGE_WORDS - 1);
+
+    return page->visible[i] & page->bools[i];
+}
+
+extern struct value_page *__value_write(struct values *, symbol_t);
+
+static inline const struct value_page *value_get(const struct values *values,
+    symbol_t id)
+{
+    return values->pages[id >> VALUES_PAGE_SHIFT];
+}
+
+/* Page of 'id' to write; It is copied if it is shared. */
+static inline struct value_page *value_write(struct values *values,
+    symbol_t id)
+{
+    struct value_page *page = values->pages[id >> VALUES_PAGE_SHIFT];
+
+    if (__atomic_load_n(&page->users, __ATOMIC_ACQUIRE) > 1)
+        return __value_write(values, id);
+
+    return page;
+}
+
+extern int share_values(struct values *, const struct values *);
+extern void release_values(struct values *);
+
+#endif /* __VALUES_H__ */